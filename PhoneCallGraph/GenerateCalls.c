@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+/*
+ * File: GenerateCalls.c
+ * Author: Chance Krueger
+ * Purpose: Writes reproducible synthetic input for benchmarking PhoneCallGraph:
+ *          a call file in the ddd-ddd-dddd ddd-ddd-dddd format and a matching
+ *          query file. Numbers are drawn with a skewed (power-law) popularity,
+ *          so a few numbers get most of the calls the way call centers do, and
+ *          a share of the lines repeat an earlier pair so the call counts of
+ *          existing edges get incremented too. The same options and seed
+ *          always produce the same files.
+ */
+
+
+
+// Number of recent pairs remembered for duplicate lines.
+#define RECENT_PAIRS 4096
+
+// Multiplier coprime with 10^10, so rank -> number is a bijection that
+// scatters popular numbers across the whole number space. The product is
+// taken in 128 bits: rank * NUMBER_SCRAMBLE overflows 64 bits for ranks
+// past about 6.9e9, which -n allows.
+#define NUMBER_SCRAMBLE 2654435761ULL
+#define NUMBER_SPACE 10000000000ULL
+
+
+
+/*
+* genOptions -- settings of one run, filled from argv.
+* nodes: how many distinct numbers can appear.
+* lines: call records to write.
+* queries: query pairs to write.
+* dupRatio: share of call records that repeat a recent pair.
+* skew: popularity exponent; 1 is uniform, larger values favor popular numbers more.
+* seed: seed of the random generator.
+*/
+struct genOptions {
+	uint64_t nodes;
+	uint64_t lines;
+	uint64_t queries;
+	double dupRatio;
+	double skew;
+	uint64_t seed;
+};
+
+
+
+/*
+* nextRandom(state) -- xorshift64* step; returns the next 64-bit value and
+* advances *state (which must not be 0).
+*/
+uint64_t nextRandom(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+
+
+/*
+* randomUnit(state) -- uniform double in [0, 1).
+*/
+double randomUnit(uint64_t *state) {
+	return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+/*
+* pickNumber(opt, state) -- draws a packed phone number. The rank is
+* nodes * u^skew for a uniform u, so low ranks (popular numbers) come up far
+* more often than high ones; the rank is then scrambled into a number.
+*/
+uint64_t pickNumber(struct genOptions *opt, uint64_t *state) {
+	uint64_t rank = (uint64_t) (opt->nodes * pow(randomUnit(state), opt->skew));
+	if (rank >= opt->nodes) {
+		rank = opt->nodes - 1;
+	}
+	return (uint64_t) ((unsigned __int128) rank * NUMBER_SCRAMBLE % NUMBER_SPACE);
+}
+
+
+
+/*
+* writePair(out, key1, key2) -- writes one "ddd-ddd-dddd ddd-ddd-dddd" line.
+*/
+void writePair(FILE *out, uint64_t key1, uint64_t key2) {
+	fprintf(out, "%03u-%03u-%04u %03u-%03u-%04u\n",
+		(unsigned) (key1 / 10000000), (unsigned) (key1 / 10000 % 1000), (unsigned) (key1 % 10000),
+		(unsigned) (key2 / 10000000), (unsigned) (key2 / 10000 % 1000), (unsigned) (key2 % 10000));
+}
+
+
+
+/*
+* parseOptions(argc, argv, opt, callsPath, queriesPath) -- reads the options
+* listed in usage() into opt and the two output file names.
+* Returns: 0 on success, 1 if the arguments are invalid.
+*/
+int parseOptions(int argc, char *argv[], struct genOptions *opt, char **callsPath, char **queriesPath) {
+	int files = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0' && i + 1 < argc) {
+			char *value = argv[++i];
+			switch (argv[i - 1][1]) {
+			case 'n': opt->nodes = strtoull(value, NULL, 10); break;
+			case 'l': opt->lines = strtoull(value, NULL, 10); break;
+			case 'q': opt->queries = strtoull(value, NULL, 10); break;
+			case 'd': opt->dupRatio = atof(value); break;
+			case 'a': opt->skew = atof(value); break;
+			case 's': opt->seed = strtoull(value, NULL, 10); break;
+			default: return 1;
+			}
+		} else if (files == 0) {
+			*callsPath = argv[i];
+			files++;
+		} else if (files == 1) {
+			*queriesPath = argv[i];
+			files++;
+		} else {
+			return 1;
+		}
+	}
+
+	if (files != 2 || opt->nodes == 0 || opt->nodes > NUMBER_SPACE
+			|| opt->dupRatio < 0 || opt->dupRatio > 1 || opt->skew < 1) {
+		return 1;
+	}
+	return 0;
+}
+
+
+
+/*
+* usage() -- prints the command line syntax to stderr.
+*/
+void usage() {
+	fprintf(stderr, "Usage: GenerateCalls [-n numbers] [-l lines] [-q queries] [-d dupRatio]"
+		" [-a skew] [-s seed] callsFile queriesFile\n");
+}
+
+
+
+int main(int argc, char *argv[]) {
+	struct genOptions opt = { 100000, 1000000, 10000, 0.2, 2.0, 1 };
+	char *callsPath = NULL;
+	char *queriesPath = NULL;
+
+	if (parseOptions(argc, argv, &opt, &callsPath, &queriesPath)) {
+		usage();
+		return 1;
+	}
+
+	FILE *calls = fopen(callsPath, "w");
+	FILE *queries = fopen(queriesPath, "w");
+	if (calls == NULL || queries == NULL) {
+		fprintf(stderr, "Could Not Open File.\n");
+		return 1;
+	}
+
+	// 0 is the one state xorshift can't leave.
+	uint64_t state = opt.seed ^ 0x9e3779b97f4a7c15ULL;
+	if (state == 0) {
+		state = 1;
+	}
+
+	uint64_t recent[RECENT_PAIRS][2];
+	uint64_t nRecent = 0;
+
+	for (uint64_t line = 0; line < opt.lines; line++) {
+		uint64_t key1, key2;
+		if (nRecent > 0 && randomUnit(&state) < opt.dupRatio) {
+			uint64_t r = nextRandom(&state) % (nRecent < RECENT_PAIRS ? nRecent : RECENT_PAIRS);
+			key1 = recent[r][0];
+			key2 = recent[r][1];
+		} else {
+			key1 = pickNumber(&opt, &state);
+			key2 = pickNumber(&opt, &state);
+			recent[nRecent % RECENT_PAIRS][0] = key1;
+			recent[nRecent % RECENT_PAIRS][1] = key2;
+			nRecent++;
+		}
+		writePair(calls, key1, key2);
+	}
+
+	for (uint64_t q = 0; q < opt.queries; q++) {
+		writePair(queries, pickNumber(&opt, &state), pickNumber(&opt, &state));
+	}
+
+	int failed = fclose(calls) != 0;
+	failed |= fclose(queries) != 0;
+	if (failed) {
+		fprintf(stderr, "Could Not Write File.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -2,6 +2,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <signal.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
  * File: calls.c
@@ -16,750 +30,4017 @@
 
 
 int parseFile(char[]);
+void publishGraph();
 
 
 
 /*
 * phoneNode -- represents a node in the phone-call graph.
-* pNumber: stores the phone number (format ddd-ddd-dddd, 12 chars + '\0').
-* calls: pointer to a linked list of edges (outgoing calls from this number).
+* key: the phone number packed as the integer value of its 10 digits
+*      (ddd-ddd-dddd -> dddddddddd, fits in 34 bits); see formatPhoneKey.
+* calls: array of the edges touching this number, in the order they were added.
+* degree / callsCap: entries used / allocated in calls (callsCap is a power of two).
+* neighborIndex: open-addressing table of the same edges keyed on the other
+*                endpoint, built once degree passes SMALL_DEGREE (NULL before).
+* indexCap: number of slots in neighborIndex.
 * next: pointer to the next phoneNode in the overall linked list.
-* level: used to record BFS depth when searching the graph.
-* queued: flag indicating whether this node is currently in the BFS queue.
+* id: position of the node in headLL (0-based), used as its index in the
+*     arrays of the frozen csrGraph.
 */
 struct phoneNode {
-	char pNumber[13];
-	struct edges *calls;
+	uint64_t key;
+	struct edges **calls;
+	uint32_t degree;
+	uint32_t callsCap;
+	struct edges **neighborIndex;
+	uint32_t indexCap;
+	uint32_t id;
 	struct phoneNode *next;
-	int level;
-	int queued;
 };
 
 
 /*
-* edges -- represents an edge in the phone-call graph.
-* to: pointer to the destination phoneNode for this call.
-* next: pointer to the next edge in the linked list of calls.
+* edges -- represents an undirected edge in the phone-call graph. There is a
+* single record per pair of numbers, listed in the calls array of both.
+* a / b: the two endpoints (a == b for a number that called itself).
 * totalCalls: count of how many calls have occurred along this edge.
 */
 struct edges {
-	struct phoneNode *to;
-	struct edges *next;
+	struct phoneNode *a;
+	struct phoneNode *b;
 	int totalCalls;
 };
 
+// Nodes with at most this many edges are searched linearly; busier nodes
+// get a neighborIndex.
+#define SMALL_DEGREE 8
+
+
+/*
+* csrGraph -- read-only compressed sparse row copy of the graph built by
+* freezeGraph once ingest is done. Node u's neighbors are
+* adj[offsets[u]] .. adj[offsets[u + 1] - 1], with the matching call counts
+* at the same positions of calls. Queries run over these arrays instead of
+* the phoneNode / edges lists.
+* nNodes: number of nodes (ids 0 .. nNodes - 1).
+* nEntries: number of adjacency entries (each undirected edge appears twice).
+* keys: packed phone number of each node.
+* component: label of the connected component of each node (see labelComponents).
+* nComponents: number of components (labels 0 .. nComponents - 1).
+* index / indexCap: number -> id table of a graph loaded from a snapshot
+*                   (NULL for a frozen graph, which resolves numbers through phoneIdx).
+* mapping / mappingSize: the mmap'ed snapshot the arrays point into, or NULL
+*                        when they were malloc'ed by freezeGraph.
+* version: graphVersion of a graph published with --live (see publishGraph), 0 otherwise.
+*/
+struct csrGraph {
+	uint32_t nNodes;
+	size_t nEntries;
+	uint64_t *keys;
+	uint64_t *offsets;
+	uint32_t *adj;
+	int *calls;
+	uint32_t *component;
+	uint32_t nComponents;
+	struct snapshotSlot *index;
+	uint64_t indexCap;
+	void *mapping;
+	size_t mappingSize;
+	unsigned long version;
+};
+
+
+/*
+* snapshotHeader -- first bytes of a snapshot file written by saveSnapshot.
+* The header is followed by these sections, each padded to 8 bytes:
+*   keys[nNodes] (uint64), offsets[nNodes + 1] (uint64),
+*   index[indexCap] (snapshotSlot), adj[nEntries] (uint32), calls[nEntries] (int32),
+*   component[nNodes] (uint32).
+* Values are stored in the machine's native byte order.
+*/
+struct snapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t nNodes;
+	uint64_t nEntries;
+	uint64_t indexCap;
+	uint32_t nComponents;
+	uint32_t unused;
+};
+
+
+/*
+* snapshotSlot -- one entry of the open-addressing (linear probing) table
+* stored in a snapshot to find a node id from its number without rebuilding
+* phoneIdx. id == SNAPSHOT_EMPTY marks an empty slot.
+*/
+struct snapshotSlot {
+	uint64_t key;
+	uint32_t id;
+	uint32_t unused;
+};
+
+#define SNAPSHOT_MAGIC "PCGSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_EMPTY UINT32_MAX
+
+
+/*
+* bfsScratch -- working state for BFS, sized once for a graph and reused by
+* every query so a search does no heap allocation.
+* capacity: number of node ids the arrays can hold.
+* frontier: FIFO of node ids. Every node is queued at most once per search,
+*           so capacity entries are enough and the queue never wraps.
+* backFrontier: second FIFO, used by the target side of bidirectionalBFS.
+* level: BFS depth of each queued node (from whichever side queued it),
+*        indexed by node id.
+* mark: epoch in which each node id was last queued. A node is queued in the
+*       current search only if mark[id] == epoch, so nothing has to be
+*       cleared between searches.
+* parent: node each queued node was reached from (the roots have level 0),
+*         so tracePath can walk a shortest path back.
+* path: output buffer of tracePath, one node id per step.
+* epoch: stamp of the current search, bumped by startSearch.
+* meetFwd / meetBack: where the last successful search joined: the last node
+*                     reached from the start side and, for bidirectionalBFS,
+*                     the first node of the target side (NO_NODE otherwise).
+* visited: number of nodes the last search queued.
+* strength: for strongestPath, the weakest call count on the best path found
+*           to each reached node (allocated only with --strongest). That
+*           search keeps its heap in frontier and each node's heap position
+*           in backFrontier.
+*/
+struct bfsScratch {
+	uint32_t capacity;
+	uint32_t *frontier;
+	uint32_t *backFrontier;
+	int *level;
+	uint32_t *mark;
+	uint32_t *parent;
+	uint32_t *path;
+	uint32_t epoch;
+	uint32_t meetFwd;
+	uint32_t meetBack;
+	uint32_t visited;
+	int *strength;
+};
+
+#define NO_NODE UINT32_MAX
+
+
+
+struct phoneNode *headLL = NULL;
+struct phoneNode *tailLL = NULL;
+uint32_t nodeCount = 0;
+
+// Every phoneNode by id (nodesByIdCap slots, a power of two), so searches
+// over the live graph can go from a queued id back to its node.
+struct phoneNode **nodesById = NULL;
+uint32_t nodesByIdCap = 0;
+
+// Frozen copy of the graph used by queries; rebuilt when graphDirty is set.
+struct csrGraph *frozenGraph = NULL;
+int graphDirty = 1;
+// Bumped every time frozenGraph is rebuilt, so caches of query answers can
+// tell they are out of date.
+unsigned long graphVersion = 0;
+
+// BFS state shared by the queries answered from main.
+struct bfsScratch queryScratch = { 0, NULL, NULL, NULL, NULL, NULL, NULL, 0, NO_NODE, NO_NODE, 0, NULL };
+
+// Answer queries with the one-sided BFS instead of bidirectionalBFS.
+int oneSidedSearch = 0;
+
+// Print the numbers along each connection after its answer (-l).
+int printPaths = 0;
+
+// --stream: stdin mixes call records and queries (see runStream).
+int streamMode = 0;
+
+// --live: the input files are parsed on a writer thread while queries run
+// against the graphs it publishes (see publishGraph).
+int liveMode = 0;
+// Fewest lines the --live writer parses between two published graphs.
+#define LIVE_PUBLISH_MIN_LINES (1 << 16)
+// Lines the --live writer has parsed so far, and the count at which it
+// publishes next (writer thread only; see publishGraph).
+size_t liveLines = 0;
+size_t liveNextPublish = LIVE_PUBLISH_MIN_LINES;
+
+// --strongest: answer queries with strongestPath instead of the fewest hops.
+int strongestMode = 0;
+
+// --hops K: each query is one number, answered with every number within K hops.
+int hopLimit = 0;
+// Output of printNeighborhood is gathered here and written out whenever it fills up.
+#define HOP_OUTPUT_SIZE (1 << 16)
+char hopOutput[HOP_OUTPUT_SIZE];
+
+// --top K: print the K heaviest numbers and pairs instead of answering queries.
+int topCount = 0;
+
+// Number of threads used to parse the input files and answer -q queries (-j N).
+// With --live the files are parsed on one thread and this only counts -q readers.
+int ingestThreads = 1;
+
+
+
+/*
+* indexSlot -- one entry of the phone number index. The key is kept next to
+* the node pointer so probing compares integers without touching the node.
+*/
+struct indexSlot {
+	uint64_t key;
+	struct phoneNode *node;
+};
+
+
+/*
+* phoneIndex -- open-addressing hash table that maps a phone number to its
+* phoneNode so lookups don't have to walk headLL.
+* slots: array of capacity entries, a NULL node marks an empty slot (linear probing).
+* capacity: number of slots, always a power of two.
+* count: number of occupied slots.
+* lookups / probes: running totals used to report the average probe length.
+* grows: how many times the table has been resized.
+*/
+struct phoneIndex {
+	struct indexSlot *slots;
+	size_t capacity;
+	size_t count;
+	size_t lookups;
+	size_t probes;
+	int grows;
+};
+
+#define INDEX_INITIAL_CAPACITY 1024
+// Grow once the table would be more than 70% full.
+#define INDEX_MAX_LOAD_NUM 7
+#define INDEX_MAX_LOAD_DEN 10
+
+#define LATENCY_BUCKETS 32
+
+struct phoneIndex phoneIdx = { NULL, 0, 0, 0, 0, 0 };
+
+int statsEnabled = 0;
+
+// --bench: time ingest and queries and report their rates on exit.
+int benchEnabled = 0;
+// Input lines seen by parseBuffer (valid or not), summed over all threads.
+atomic_size_t linesRead = 0;
+// parseBuffer adds its line counts to linesRead and stats.linesRejected after
+// this many lines, so a SIGUSR1 report in the middle of a big file sees them.
+#define LINE_COUNT_FLUSH (1 << 16)
+// Query lines answered from stdin or a -q file.
+size_t queriesAnswered = 0;
+
+
+/*
+* hotStats -- counters of the ingest and query hot paths, reported by --stats
+* on exit and, while the program runs, on SIGUSR1 (see statsThread). They
+* are atomics so that report can read them from its own thread; counters with
+* a single writer are bumped with statBump, which is a plain add.
+* linesRejected: input lines skipped for format errors.
+* nodesCreated / edgesCreated: phoneNode and edges records added to the graph.
+* edgeIncrements: calls added to an edge that already existed.
+* searches / nodesVisited / maxVisited: BFS runs and the nodes they queued.
+* searchLatency: BFS runs by duration, bucket b counting runs under 2^b
+*                microseconds (only timed with --stats).
+* heapAllocations: blocks handed out or resized by mallocOrExit, callocOrExit
+*                  and reallocOrExit (only counted with --stats).
+*/
+struct hotStats {
+	atomic_size_t linesRejected;
+	atomic_size_t nodesCreated;
+	atomic_size_t edgesCreated;
+	atomic_size_t edgeIncrements;
+	atomic_size_t searches;
+	atomic_size_t nodesVisited;
+	atomic_size_t maxVisited;
+	atomic_size_t searchLatency[LATENCY_BUCKETS];
+	atomic_size_t heapAllocations;
+};
+
+struct hotStats stats;
+
+
+
+/*
+* checkAllocation(mem, size) -- the common tail of the *OrExit allocators:
+* counts the block for --stats and exits with "Not Enough Memory." if the
+* allocation of size bytes failed.
+* Returns: mem.
+*/
+void *checkAllocation(void *mem, size_t size) {
+	if (mem == NULL && size != 0) {
+		fprintf(stderr, "Not Enough Memory.\n");
+		exit(1);
+	}
+	if (statsEnabled) {
+		atomic_fetch_add_explicit(&stats.heapAllocations, 1, memory_order_relaxed);
+	}
+	return mem;
+}
+
+
+
+/*
+* mallocOrExit(size) -- malloc that reports "Not Enough Memory." and exits
+* the program instead of returning NULL.
+*/
+void *mallocOrExit(size_t size) {
+	return checkAllocation(malloc(size), size);
+}
+
+
+
+/*
+* callocOrExit(n, size) -- calloc with the same failure handling as mallocOrExit.
+*/
+void *callocOrExit(size_t n, size_t size) {
+	return checkAllocation(calloc(n, size), n * size);
+}
+
+
+
+/*
+* reallocOrExit(mem, size) -- realloc with the same failure handling as
+* mallocOrExit. Every resize counts as an allocation.
+*/
+void *reallocOrExit(void *mem, size_t size) {
+	return checkAllocation(realloc(mem, size), size);
+}
+
+
+
+/*
+* statBump(counter, n) -- adds n to a hotStats counter that only one thread
+* writes (the one building the graph). Other threads may read it at any time.
+*/
+void statBump(atomic_size_t *counter, size_t n) {
+	atomic_store_explicit(counter,
+		atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+
+
+/*
+* clockSeconds() -- monotonic time in seconds, used by the --bench and
+* --stats timers.
+*/
+double clockSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/*
+* arenaBlock -- one chunk of memory owned by an arena.
+* next: previously filled block.
+* size / used: bytes available in data and bytes already handed out.
+*/
+struct arenaBlock {
+	struct arenaBlock *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+
+/*
+* arena -- bump allocator that owns every phoneNode and edges record of the
+* graph. Records are never freed one by one; arenaRelease returns whole
+* blocks at teardown.
+* blocks: most recent block first.
+* reserved: bytes obtained from malloc (headers included).
+* used: bytes handed out to callers (alignment padding included).
+* allocations: number of records handed out.
+* freeLists: arrays given back with arenaFreeArray, one list per power-of-two
+*            size class, reused by arenaAllocArray before carving new space.
+* recycled: bytes currently sitting in freeLists.
+*/
+struct arena {
+	struct arenaBlock *blocks;
+	size_t reserved;
+	size_t used;
+	size_t allocations;
+	void *freeLists[32];
+	size_t recycled;
+};
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGN 8
+
+struct arena graphArena = { NULL, 0, 0, 0, { NULL }, 0 };
+
+
+
+/*
+* arenaAlloc(a, size) -- returns size bytes (aligned to ARENA_ALIGN) from the
+* current block of a, starting a new block when it is full.
+* Side effects: exits with "Not Enough Memory." if a block can't be allocated.
+*/
+void *arenaAlloc(struct arena *a, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	if (a->blocks == NULL || a->blocks->size - a->blocks->used < size) {
+		size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		struct arenaBlock *block = mallocOrExit(sizeof(struct arenaBlock) + blockSize);
+		block->next = a->blocks;
+		block->size = blockSize;
+		block->used = 0;
+		a->blocks = block;
+		a->reserved += sizeof(struct arenaBlock) + blockSize;
+	}
+
+	void *mem = a->blocks->data + a->blocks->used;
+	a->blocks->used += size;
+	a->used += size;
+	a->allocations++;
+	return mem;
+}
+
+
+
+/*
+* sizeClass(n) -- smallest c with (1 << c) >= n, for n >= 1.
+*/
+int sizeClass(uint32_t n) {
+	int c = 0;
+	while (((uint32_t) 1 << c) < n) {
+		c++;
+	}
+	return c;
+}
+
+
+
+/*
+* arenaAllocArray(a, n) -- returns an array of n pointers from a, where n is
+* a power of two. A previously freed array of the same size is reused when
+* one is available.
+*/
+void *arenaAllocArray(struct arena *a, uint32_t n) {
+	int c = sizeClass(n);
+	void *mem = a->freeLists[c];
+
+	if (mem != NULL) {
+		a->freeLists[c] = *(void **) mem;
+		a->recycled -= (size_t) n * sizeof(void *);
+		return mem;
+	}
+	return arenaAlloc(a, (size_t) n * sizeof(void *));
+}
+
+
+
+/*
+* arenaFreeArray(a, mem, n) -- gives an array from arenaAllocArray(a, n)
+* back to a so a later request of the same size can reuse it.
+*/
+void arenaFreeArray(struct arena *a, void *mem, uint32_t n) {
+	int c = sizeClass(n);
+
+	*(void **) mem = a->freeLists[c];
+	a->freeLists[c] = mem;
+	a->recycled += (size_t) n * sizeof(void *);
+}
+
+
+
+/*
+* arenaRelease(a) -- frees every block of a at once and resets its counters.
+* Any pointer obtained from a is invalid afterwards.
+*/
+void arenaRelease(struct arena *a) {
+	struct arenaBlock *block = a->blocks;
+	while (block != NULL) {
+		struct arenaBlock *next = block->next;
+		free(block);
+		block = next;
+	}
+	a->blocks = NULL;
+	a->reserved = 0;
+	a->used = 0;
+	a->allocations = 0;
+	memset(a->freeLists, 0, sizeof(a->freeLists));
+	a->recycled = 0;
+}
+
+
+
+/*
+* printArenaStats(out) -- writes how much of the graph arena is in use.
+*/
+void printArenaStats(FILE *out) {
+	size_t nBlocks = 0;
+	for (struct arenaBlock *block = graphArena.blocks; block != NULL; block = block->next) {
+		nBlocks++;
+	}
+	fprintf(out, "Arena: %zu records, %zu bytes used of %zu reserved in %zu blocks, "
+		"%zu bytes awaiting reuse\n",
+		graphArena.allocations, graphArena.used, graphArena.reserved, nBlocks,
+		graphArena.recycled);
+}
+
+
+
+/*
+* hashKey(key) -- mixes the bits of a packed phone number (64-bit finalizer
+* from MurmurHash3) so that consecutive numbers spread across the table.
+* Returns: the 64-bit hash value.
+*/
+uint64_t hashKey(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+
+
+/*
+* indexFindSlot(slots, capacity, key) -- linear probe for key.
+* Returns: the index of the slot holding key, or of the empty slot
+* where it would be inserted.
+* Side effects: updates the lookup / probe counters of phoneIdx.
+*/
+size_t indexFindSlot(struct indexSlot *slots, size_t capacity, uint64_t key) {
+	size_t mask = capacity - 1;
+	size_t pos = hashKey(key) & mask;
+
+	phoneIdx.lookups++;
+	while (slots[pos].node != NULL && slots[pos].key != key) {
+		pos = (pos + 1) & mask;
+		phoneIdx.probes++;
+	}
+	return pos;
+}
+
+
+
+/*
+* indexGrow() -- doubles the capacity of phoneIdx (or creates it on first use)
+* and re-inserts every node it holds.
+* Side effects: frees the old slot array; exits if memory runs out.
+*/
+void indexGrow() {
+	size_t newCap = phoneIdx.capacity ? phoneIdx.capacity * 2 : INDEX_INITIAL_CAPACITY;
+	struct indexSlot *newSlots = callocOrExit(newCap, sizeof(struct indexSlot));
+
+	for (size_t i = 0; i < phoneIdx.capacity; i++) {
+		if (phoneIdx.slots[i].node != NULL) {
+			size_t pos = hashKey(phoneIdx.slots[i].key) & (newCap - 1);
+			while (newSlots[pos].node != NULL) {
+				pos = (pos + 1) & (newCap - 1);
+			}
+			newSlots[pos] = phoneIdx.slots[i];
+		}
+	}
+
+	if (phoneIdx.slots != NULL) {
+		phoneIdx.grows++;
+	}
+	free(phoneIdx.slots);
+	phoneIdx.slots = newSlots;
+	phoneIdx.capacity = newCap;
+}
+
+
+
+/*
+* indexLookup(key) -- finds the phoneNode for the packed number key.
+* Returns: the node, or NULL if the number is not in the graph.
+*/
+struct phoneNode *indexLookup(uint64_t key) {
+	if (phoneIdx.count == 0) {
+		return NULL;
+	}
+	return phoneIdx.slots[indexFindSlot(phoneIdx.slots, phoneIdx.capacity, key)].node;
+}
+
+
+
+/*
+* formatPhoneKey(key, out) -- turns a packed number back into its
+* ddd-ddd-dddd text form. Only used when a number has to be printed.
+* out: buffer of at least 13 chars, receives the null-terminated number.
+*/
+void formatPhoneKey(uint64_t key, char *out) {
+	snprintf(out, 13, "%03u-%03u-%04u", (unsigned) (key / 10000000),
+		(unsigned) (key / 10000 % 1000), (unsigned) (key % 10000));
+}
+
+
+
+/*
+* printIndexStats(out) -- writes the size, load factor and average probe
+* length of phoneIdx to out.
+*/
+void printIndexStats(FILE *out) {
+	double load = phoneIdx.capacity ? (double) phoneIdx.count / phoneIdx.capacity : 0.0;
+	double avgProbe = phoneIdx.lookups ? (double) phoneIdx.probes / phoneIdx.lookups : 0.0;
+
+	fprintf(out, "Index: %zu numbers in %zu slots, load factor %.3f, "
+		"%.3f extra probes per lookup, %d grows\n",
+		phoneIdx.count, phoneIdx.capacity, load, avgProbe, phoneIdx.grows);
+}
+
+
+
+
+/*
+* edgeOther(e, self) -- returns the endpoint of e that isn't self.
+*/
+struct phoneNode *edgeOther(struct edges *e, struct phoneNode *self) {
+	return e->a == self ? e->b : e->a;
+}
+
+
+
+/*
+* indexNeighbor(p, e) -- inserts edge e into p's neighborIndex, keyed on the
+* endpoint of e other than p. Assumes the index has a free slot.
+*/
+void indexNeighbor(struct phoneNode *p, struct edges *e) {
+	size_t mask = p->indexCap - 1;
+	size_t pos = hashKey(edgeOther(e, p)->key) & mask;
+
+	while (p->neighborIndex[pos] != NULL) {
+		pos = (pos + 1) & mask;
+	}
+	p->neighborIndex[pos] = e;
+}
+
+
+
+/*
+* rebuildNeighborIndex(p, capacity) -- replaces p's neighborIndex with an
+* empty one of capacity slots and re-inserts every edge of p.
+*/
+void rebuildNeighborIndex(struct phoneNode *p, uint32_t capacity) {
+	if (p->neighborIndex != NULL) {
+		arenaFreeArray(&graphArena, p->neighborIndex, p->indexCap);
+	}
+	p->neighborIndex = arenaAllocArray(&graphArena, capacity);
+	memset(p->neighborIndex, 0, (size_t) capacity * sizeof(struct edges *));
+	p->indexCap = capacity;
+
+	for (uint32_t i = 0; i < p->degree; i++) {
+		indexNeighbor(p, p->calls[i]);
+	}
+}
+
+
+
+/*
+* appendEdge(p, e) -- adds e to p's calls array, growing the array (and the
+* neighbor index, kept at most half full) as needed.
+*/
+void appendEdge(struct phoneNode *p, struct edges *e) {
+	if (p->degree == p->callsCap) {
+		uint32_t newCap = p->callsCap ? p->callsCap * 2 : 2;
+		struct edges **newCalls = arenaAllocArray(&graphArena, newCap);
+		if (p->calls != NULL) {
+			memcpy(newCalls, p->calls, (size_t) p->degree * sizeof(struct edges *));
+			arenaFreeArray(&graphArena, p->calls, p->callsCap);
+		}
+		p->calls = newCalls;
+		p->callsCap = newCap;
+	}
+	p->calls[p->degree++] = e;
+
+	if (p->neighborIndex != NULL && p->degree * 2 <= p->indexCap) {
+		indexNeighbor(p, e);
+	} else if (p->degree > SMALL_DEGREE) {
+		// Covers both creating the index and doubling a full one.
+		rebuildNeighborIndex(p, p->indexCap ? p->indexCap * 2 : 4 * SMALL_DEGREE);
+	}
+}
+
+
+
+/*
+* findEdge(p1, p2) -- returns the edge between p1 and p2, or NULL if they
+* never called each other. Looks from the endpoint with the smaller degree:
+* a short calls array is scanned, a busy node's neighborIndex is probed, so
+* the lookup is O(1) even between two hub numbers.
+*/
+struct edges *findEdge(struct phoneNode *p1, struct phoneNode *p2) {
+	struct phoneNode *from = p1->degree <= p2->degree ? p1 : p2;
+	struct phoneNode *to = from == p1 ? p2 : p1;
+
+	if (from->neighborIndex == NULL) {
+		for (uint32_t i = 0; i < from->degree; i++) {
+			if (edgeOther(from->calls[i], from) == to) {
+				return from->calls[i];
+			}
+		}
+		return NULL;
+	}
+
+	size_t mask = from->indexCap - 1;
+	size_t pos = hashKey(to->key) & mask;
+	while (from->neighborIndex[pos] != NULL) {
+		if (edgeOther(from->neighborIndex[pos], from) == to) {
+			return from->neighborIndex[pos];
+		}
+		pos = (pos + 1) & mask;
+	}
+	return NULL;
+}
+
+
+
+/*
+* addEdges(p1, p2, calls) -- ensures there is an undirected edge between phone nodes p1 and p2.
+* If the edge already exists, adds calls to its totalCalls count; otherwise allocates a new
+* edge with totalCalls initialized to calls and lists it in both p1->calls and p2->calls.
+* Since both nodes share the one record, the count only has to be updated once.
+* A new edge made with calls > 1 (a merged pair table, a thawed snapshot) stands for one call
+* that created it and calls - 1 added to it, and --stats counts them that way, as a serial run would.
+* Assumes p1 and p2 are non-NULL and calls is positive (1 for a single record).
+*/
+void addEdges(struct phoneNode *p1, struct phoneNode *p2, int calls) {
+
+	graphDirty = 1;
+
+	struct edges *edge = findEdge(p1, p2);
+	if (edge != NULL) {
+		edge->totalCalls += calls;
+		statBump(&stats.edgeIncrements, calls);
+		return;
+	}
+
+	edge = arenaAlloc(&graphArena, sizeof(struct edges));
+	statBump(&stats.edgesCreated, 1);
+	if (calls > 1) {
+		statBump(&stats.edgeIncrements, calls - 1);
+	}
+	edge->a = p1;
+	edge->b = p2;
+	edge->totalCalls = calls;
+
+	appendEdge(p1, edge);
+	// A number calling itself only has the one edge to list.
+	if (p1 != p2) {
+		appendEdge(p2, edge);
+	}
+}
+
+
+
+/*
+* findOrAddNode(key) -- returns the phoneNode for the packed number key, creating
+* it and appending it to headLL (and the index) if it isn't in the graph yet.
+*
+* key            : phone number packed by checkPhoneFormat
+* Returns        : the existing or newly allocated phoneNode (owned by graphArena)
+* Assumptions    : memory allocation succeeds (or else the program exits).
+*/
+struct phoneNode *findOrAddNode(uint64_t key) {
+
+	// Keep the load factor under the limit before probing for a free slot.
+	if ((phoneIdx.count + 1) * INDEX_MAX_LOAD_DEN > phoneIdx.capacity * INDEX_MAX_LOAD_NUM) {
+		indexGrow();
+	}
+
+	size_t pos = indexFindSlot(phoneIdx.slots, phoneIdx.capacity, key);
+	if (phoneIdx.slots[pos].node != NULL) {
+		return phoneIdx.slots[pos].node;
+	}
+
+	struct phoneNode *p = arenaAlloc(&graphArena, sizeof(struct phoneNode));
+	p->key = key;
+	p->calls = NULL;
+	p->degree = 0;
+	p->callsCap = 0;
+	p->neighborIndex = NULL;
+	p->indexCap = 0;
+	p->next = NULL;
+	p->id = nodeCount++;
+	statBump(&stats.nodesCreated, 1);
+
+	if (p->id == nodesByIdCap) {
+		uint32_t newCap = nodesByIdCap ? nodesByIdCap * 2 : INDEX_INITIAL_CAPACITY;
+		struct phoneNode **grown = arenaAllocArray(&graphArena, newCap);
+		if (nodesById != NULL) {
+			memcpy(grown, nodesById, (size_t) nodesByIdCap * sizeof(struct phoneNode *));
+			arenaFreeArray(&graphArena, nodesById, nodesByIdCap);
+		}
+		nodesById = grown;
+		nodesByIdCap = newCap;
+	}
+	nodesById[p->id] = p;
+
+	if (tailLL == NULL) {
+		headLL = p;
+	} else {
+		tailLL->next = p;
+	}
+	tailLL = p;
+
+	phoneIdx.slots[pos].key = key;
+	phoneIdx.slots[pos].node = p;
+	phoneIdx.count++;
+	return p;
+}
+
+
+
+/*
+* addNodesToLL(key1, key2) -- ensures that both phone numbers
+* are present as nodes in the global linked list headLL and then connects them
+* by calling addEdges. Nodes are resolved through the phoneIdx hash index, so
+* this is O(1) amortized instead of a scan of the whole list.
+*
+* key1           : packed phone number of the first number
+* key2           : packed phone number of the second number
+* Returns        : void
+* Assumptions    : memory allocation succeeds (or else the program exits).
+*/
+void addNodesToLL(uint64_t key1, uint64_t key2) {
+
+	struct phoneNode *p1 = findOrAddNode(key1);
+	struct phoneNode *p2 = findOrAddNode(key2);
+
+	addEdges(p1, p2, 1);
+}
+
+
+
+/*
+* checkPhoneFormat(phoneNum, len, key) -- checks if the len chars at phoneNum
+* match the format ddd-ddd-dddd exactly and, if so, packs the ten digits into
+* *key. Returns 0 if valid, 1 otherwise (*key is left untouched).
+*
+* phoneNum: pointer to the first char of the number (need not be terminated).
+* Assumes: phoneNum is non-NULL and key points to writable storage.
+*/
+int checkPhoneFormat(const char *phoneNum, int len, uint64_t *key) {
+	uint64_t packed = 0;
+
+	if (len != 12) {
+		return 1;  // Too long or too short
+	}
+
+	for (int index = 0; index < 12; index++) {
+		if (index == 3 || index == 7) {
+			if (phoneNum[index] != '-') {
+				return 1;  // Dash expected
+			}
+		} else {
+			if (phoneNum[index] < '0' || phoneNum[index] > '9') {
+				return 1;  // Digit expected
+			}
+			packed = packed * 10 + (phoneNum[index] - '0');
+		}
+	}
+
+	*key = packed;
+	return 0;  // Valid format
+}
+
+
+
+/*
+* parsePhoneLine(line, len, key1, key2, errSeen) -- splits one line of input
+* into its two phone numbers and packs them with checkPhoneFormat. A number is
+* a run of digits and dashes; the two are separated by whitespace and only
+* whitespace may follow the second one.
+*
+* line    : the line's characters; scanning also stops at a '\0'.
+* len     : number of chars in line.
+* key1/2  : receive the packed numbers when the line is valid.
+* errSeen : set to 1 for lines with too many or extra characters.
+* Returns : 0 if both numbers were packed, 1 if the line must be skipped
+*           (an error message has been printed to stderr).
+*/
+int parsePhoneLine(const char *line, size_t len, uint64_t *key1, uint64_t *key2, int *errSeen) {
+	size_t i = 0;
+	int skipLine = 0;
+	int len1 = 0, len2 = 0;
+
+	while (i < len && ((line[i] >= '0' && line[i] <= '9') || line[i] == '-')) {
+		if (len1 == 12) {
+			fprintf(stderr, "Too Many Args Given");
+			skipLine = 1;
+			*errSeen = 1;
+			break;
+		}
+		len1++;
+		i++;
+	}
+
+	// Skip whitespace
+	while (i < len && isspace((unsigned char) line[i])) {
+		i++;
+	}
+
+	size_t start2 = i;
+	while (i < len && ((line[i] >= '0' && line[i] <= '9') || line[i] == '-')) {
+		if (len2 == 12) {
+			fprintf(stderr, "Too Many Args Given");
+			skipLine = 1;
+			*errSeen = 1;
+			break;
+		}
+		len2++;
+		i++;
+	}
+
+	while (i < len && line[i] != 0) {
+		// Extra Input was added.
+		if (! isspace((unsigned char) line[i])) {
+			*errSeen = 1;
+			skipLine = 1;
+			fprintf(stderr, "Incorrect Format.\n");
+			break;
+		}
+		i++;
+	}
+
+	if (skipLine) {
+		return 1;
+	}
+
+	int checkFormat = 0;
+	checkFormat += checkPhoneFormat(line, len1, key1);
+	checkFormat += checkPhoneFormat(line + start2, len2, key2);
+
+	// Incorrect Format
+	if (checkFormat) {
+		fprintf(stderr, "Incorrect Formating.\n");
+		return 1;
+	}
+	return 0;
+}
+
+
+
+/*
+* pairEntry -- one slot of a pairTable: the unordered pair of packed numbers
+* (lo <= hi) and how many calls between them have been read. calls == 0
+* marks an empty slot.
+* order: how many distinct pairs the table held before this one, i.e. the
+*        position of the pair's first call among the table's pairs.
+* loFirst: whether lo was the first number on that first line.
+*/
+struct pairEntry {
+	uint64_t lo;
+	uint64_t hi;
+	size_t order;
+	int calls;
+	int loFirst;
+};
+
+
+/*
+* pairTable -- open-addressing (linear probing) table that collects the call
+* pairs of one ingest thread so they can be merged into the graph later.
+* capacity is a power of two; count is the number of distinct pairs.
+*/
+struct pairTable {
+	struct pairEntry *slots;
+	size_t capacity;
+	size_t count;
+};
+
+
+
+/*
+* pairTableAdd(t, key1, key2) -- records one call between key1 and key2 in t,
+* doubling the table first if it would pass the index load limit.
+* Side effects: exits if memory runs out.
+*/
+void pairTableAdd(struct pairTable *t, uint64_t key1, uint64_t key2) {
+	uint64_t lo = key1 < key2 ? key1 : key2;
+	uint64_t hi = key1 < key2 ? key2 : key1;
+
+	if ((t->count + 1) * INDEX_MAX_LOAD_DEN > t->capacity * INDEX_MAX_LOAD_NUM) {
+		size_t newCap = t->capacity ? t->capacity * 2 : INDEX_INITIAL_CAPACITY;
+		struct pairEntry *newSlots = callocOrExit(newCap, sizeof(struct pairEntry));
+		for (size_t i = 0; i < t->capacity; i++) {
+			if (t->slots[i].calls != 0) {
+				size_t pos = hashKey(t->slots[i].lo * 0x9e3779b97f4a7c15ULL ^ t->slots[i].hi) & (newCap - 1);
+				while (newSlots[pos].calls != 0) {
+					pos = (pos + 1) & (newCap - 1);
+				}
+				newSlots[pos] = t->slots[i];
+			}
+		}
+		free(t->slots);
+		t->slots = newSlots;
+		t->capacity = newCap;
+	}
+
+	size_t mask = t->capacity - 1;
+	size_t pos = hashKey(lo * 0x9e3779b97f4a7c15ULL ^ hi) & mask;
+	while (t->slots[pos].calls != 0 && (t->slots[pos].lo != lo || t->slots[pos].hi != hi)) {
+		pos = (pos + 1) & mask;
+	}
+	if (t->slots[pos].calls == 0) {
+		t->slots[pos].lo = lo;
+		t->slots[pos].hi = hi;
+		t->slots[pos].order = t->count++;
+		t->slots[pos].loFirst = key1 == lo;
+	}
+	t->slots[pos].calls++;
+}
+
+
+
+/*
+* mergePairTable(t) -- adds every pair collected in t to the graph with its
+* call count, then frees the table's slots. Pairs go in in the order their
+* first call was read, each with its numbers in the order of that line, so
+* nodes and edges are created exactly as parseFile would have created them.
+* Node ids, and with them the paths -l prints, don't depend on -j.
+*/
+void mergePairTable(struct pairTable *t) {
+	size_t *byOrder = mallocOrExit(t->count * sizeof(size_t));
+
+	for (size_t i = 0; i < t->capacity; i++) {
+		if (t->slots[i].calls != 0) {
+			byOrder[t->slots[i].order] = i;
+		}
+	}
+	for (size_t n = 0; n < t->count; n++) {
+		struct pairEntry *e = &t->slots[byOrder[n]];
+		struct phoneNode *first = findOrAddNode(e->loFirst ? e->lo : e->hi);
+		struct phoneNode *second = findOrAddNode(e->loFirst ? e->hi : e->lo);
+		addEdges(first, second, e->calls);
+	}
+	free(byOrder);
+	free(t->slots);
+	t->slots = NULL;
+	t->capacity = 0;
+	t->count = 0;
+}
+
+
+
+// Length of a canonical record: "ddd-ddd-dddd ddd-ddd-dddd\n".
+#define CANONICAL_LINE_LEN 26
+
+
+
+/*
+* parseCanonicalLine(line, key1, key2) -- fast path for the common record
+* layout: two ddd-ddd-dddd numbers separated by a single space or tab and
+* followed by '\n', exactly CANONICAL_LINE_LEN bytes. With SSE2 the whole
+* record is checked with two 16-byte loads (bytes 0-15 and 10-25) and a
+* digit / dash mask compare, and the digits are packed with multiply-adds.
+* Without SSE2 it falls back to checkPhoneFormat at the fixed offsets.
+* line: must have at least CANONICAL_LINE_LEN readable bytes.
+* Returns: 1 and fills *key1 / *key2 if the line has the canonical layout,
+* 0 otherwise (the caller then runs the general parsePhoneLine).
+*/
+int parseCanonicalLine(const char *line, uint64_t *key1, uint64_t *key2) {
+	if ((line[12] != ' ' && line[12] != '\t') || line[25] != '\n') {
+		return 0;
+	}
+#ifdef __SSE2__
+	// Expected digit / dash positions of each 16-byte chunk (bit i = byte i).
+	const int digitsA = 0xef77;  // bytes 0-2, 4-6, 8-11, 13-15
+	const int dashesA = 0x0088;  // bytes 3, 7
+	const int digitsB = 0x7bbb;  // bytes 10-11, 13-15, 17-19, 21-24
+	const int dashesB = 0x0440;  // bytes 16, 20
+
+	__m128i zero = _mm_set1_epi8('0');
+	__m128i nine = _mm_set1_epi8(9);
+	__m128i dash = _mm_set1_epi8('-' - '0');
+	__m128i a = _mm_sub_epi8(_mm_loadu_si128((const __m128i *) line), zero);
+	__m128i b = _mm_sub_epi8(_mm_loadu_si128((const __m128i *) (line + 10)), zero);
+
+	// (byte - '0') <= 9 as unsigned <=> the byte is a digit.
+	int isDigitA = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(a, nine), a));
+	int isDigitB = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(b, nine), b));
+	int isDashA = _mm_movemask_epi8(_mm_cmpeq_epi8(a, dash));
+	int isDashB = _mm_movemask_epi8(_mm_cmpeq_epi8(b, dash));
+
+	if ((isDigitA & digitsA) != digitsA || (isDashA & dashesA) != dashesA ||
+	    (isDigitB & digitsB) != digitsB || (isDashB & dashesB) != dashesB) {
+		return 0;
+	}
+
+	// Widen the digit values to 16 bits and weight them so each pair of
+	// lanes sums to part of a ddd / ddd / dddd group (weights 0 drop the
+	// dashes, the separator and the newline).
+	__m128i z = _mm_setzero_si128();
+	__m128i wALo = _mm_setr_epi16(100, 10, 1, 0, 100, 10, 1, 0);
+	__m128i wAHi = _mm_setr_epi16(1000, 100, 10, 1, 0, 0, 0, 0);
+	__m128i wBLo = _mm_setr_epi16(0, 0, 0, 100, 10, 1, 0, 100);
+	__m128i wBHi = _mm_setr_epi16(10, 1, 0, 1000, 100, 10, 1, 0);
+	int32_t lanes[16];
+	_mm_storeu_si128((__m128i *) lanes, _mm_madd_epi16(_mm_unpacklo_epi8(a, z), wALo));
+	_mm_storeu_si128((__m128i *) (lanes + 4), _mm_madd_epi16(_mm_unpackhi_epi8(a, z), wAHi));
+	_mm_storeu_si128((__m128i *) (lanes + 8), _mm_madd_epi16(_mm_unpacklo_epi8(b, z), wBLo));
+	_mm_storeu_si128((__m128i *) (lanes + 12), _mm_madd_epi16(_mm_unpackhi_epi8(b, z), wBHi));
+
+	*key1 = (uint64_t) (lanes[0] + lanes[1]) * 10000000
+		+ (uint64_t) (lanes[2] + lanes[3]) * 10000 + (lanes[4] + lanes[5]);
+	*key2 = (uint64_t) (lanes[9] + lanes[10]) * 10000000
+		+ (uint64_t) (lanes[11] + lanes[12]) * 10000 + (lanes[13] + lanes[14] + lanes[15]);
+	return 1;
+#else
+	uint64_t k1, k2;
+	if (checkPhoneFormat(line, 12, &k1) || checkPhoneFormat(line + 13, 12, &k2)) {
+		return 0;
+	}
+	*key1 = k1;
+	*key2 = k2;
+	return 1;
+#endif
+}
+
+
+
+/*
+* parseBuffer(data, size, pairs, errSeen) -- parses every line of the size
+* bytes at data in place (the last line needs no trailing newline). Valid
+* pairs go to the graph via addNodesToLL, or into pairs when it isn't NULL.
+* Nothing is allocated per line; *errSeen is set as in parsePhoneLine.
+* Line counts are kept locally and flushed every LINE_COUNT_FLUSH lines.
+* With --live the graph is published whenever liveNextPublish is reached.
+*/
+void parseBuffer(const char *data, size_t size, struct pairTable *pairs, int *errSeen) {
+	const char *end = data + size;
+	const char *line = data;
+	size_t lines = 0;
+	size_t rejected = 0;
+
+	while (line < end) {
+		uint64_t key1, key2;
+
+		if (lines == LINE_COUNT_FLUSH) {
+			atomic_fetch_add(&linesRead, lines);
+			atomic_fetch_add(&stats.linesRejected, rejected);
+			lines = 0;
+			rejected = 0;
+		}
+		lines++;
+		if (end - line >= CANONICAL_LINE_LEN && parseCanonicalLine(line, &key1, &key2)) {
+			if (pairs != NULL) {
+				pairTableAdd(pairs, key1, key2);
+			} else {
+				addNodesToLL(key1, key2);
+			}
+			line += CANONICAL_LINE_LEN;
+			if (liveMode && pairs == NULL && ++liveLines >= liveNextPublish) {
+				publishGraph();
+			}
+			continue;
+		}
+
+		const char *newline = memchr(line, '\n', end - line);
+		const char *next = newline != NULL ? newline + 1 : end;
+
+		if (parsePhoneLine(line, next - line, &key1, &key2, errSeen) == 0) {
+			if (pairs != NULL) {
+				pairTableAdd(pairs, key1, key2);
+			} else {
+				addNodesToLL(key1, key2);
+			}
+		} else {
+			rejected++;
+		}
+		line = next;
+		if (liveMode && pairs == NULL && ++liveLines >= liveNextPublish) {
+			publishGraph();
+		}
+	}
+	atomic_fetch_add(&linesRead, lines);
+	atomic_fetch_add(&stats.linesRejected, rejected);
+}
+
+
+
+/*
+* parseFileInto(argv, pairs) -- reads the file named by argv, where each line contains
+* two phone numbers in the format ddd-ddd-dddd. For each valid line, it adds the pair to
+* the global graph via addNodesToLL, or only records it in pairs when pairs is not NULL
+* (pairs never touches the graph, so several threads can parse at once). Skips lines with
+* format errors (printing an error to stderr) but continues processing. Returns 1 if the
+* file could not be opened or any formatting errors were encountered; returns 0 otherwise.
+*
+* Regular files are mmap'ed and scanned in place by parseBuffer. Anything that can't be
+* mapped (pipes, empty files) is read line by line into one reused buffer instead.
+*/
+int parseFileInto(char argv[], struct pairTable *pairs) {
+
+	int errSeen = 0;
+	
+	int fd = open(argv, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "Could Not Open File.\n");
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			madvise(data, st.st_size, MADV_SEQUENTIAL);
+			parseBuffer(data, st.st_size, pairs, &errSeen);
+			munmap(data, st.st_size);
+			close(fd);
+			return errSeen;
+		}
+	}
+
+	FILE *input = fdopen(fd, "r");
+	if (input == NULL) {
+		close(fd);
+		fprintf(stderr, "Could Not Open File.\n");
+		return 1;
+	}
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t lineLen;
+	while ((lineLen = getline(&line, &len, input)) > 0) {
+		parseBuffer(line, lineLen, pairs, &errSeen);
+	}
+	free(line);
+	fclose(input);
+	return errSeen;
+}
+
+
+
+/*
+* parseFile(argv) -- parses the file named by argv straight into the global graph.
+* See parseFileInto; returns its error flag.
+*/
+int parseFile(char argv[]) {
+	return parseFileInto(argv, NULL);
+}
+
+
+
+/*
+* ingestJob -- files shared by the threads of parallelIngest. Each thread
+* claims the next unparsed file by bumping nextFile and collects its pairs
+* in the file's own table, pairs[f], so they can be merged in file order.
+* parsed[f] is set once pairs[f] is complete; merged counts the files the
+* main thread has merged so far. A thread claims no file more than window
+* files ahead of merged, so only that many tables are held at once.
+* lock guards nextFile, parsed and merged; changed is signalled when
+* either of the last two moves.
+*/
+struct ingestJob {
+	char **files;
+	int nFiles;
+	int nextFile;
+	int merged;
+	int window;
+	char *parsed;
+	struct pairTable *pairs;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+
+/*
+* ingestWorker -- per-thread state of parallelIngest: whether any of the
+* files this thread parsed had errors.
+*/
+struct ingestWorker {
+	pthread_t thread;
+	struct ingestJob *job;
+	int errSeen;
+};
+
+
+
+/*
+* ingestThread(arg) -- thread body of parallelIngest; parses files from the
+* shared job, each into its own pairTable, until none are left. Waits
+* before claiming a file while the merge is a full window behind.
+*/
+void *ingestThread(void *arg) {
+	struct ingestWorker *w = arg;
+	struct ingestJob *job = w->job;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		while (job->nextFile < job->nFiles && job->nextFile >= job->merged + job->window) {
+			pthread_cond_wait(&job->changed, &job->lock);
+		}
+		int f = job->nextFile < job->nFiles ? job->nextFile++ : -1;
+		pthread_mutex_unlock(&job->lock);
+		if (f < 0) {
+			return NULL;
+		}
+
+		w->errSeen += parseFileInto(job->files[f], &job->pairs[f]);
+
+		pthread_mutex_lock(&job->lock);
+		job->parsed[f] = 1;
+		pthread_cond_broadcast(&job->changed);
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+
+
+/*
+* parallelIngest(files, nFiles, nThreads) -- parses the files on up to
+* nThreads threads, collecting the call pairs of each file in a pairTable of
+* its own, while the calling thread merges the tables into the graph in file
+* order: file f goes in as soon as files 0..f are parsed, and its table is
+* freed right away. The resulting graph (call counts, node ids and neighbor
+* order) is the same as parsing the files in order with parseFile.
+* Returns: the number of files that reported errors.
+*/
+int parallelIngest(char **files, int nFiles, int nThreads) {
+	struct ingestJob job;
+	int errSeen = 0;
+
+	if (nThreads > nFiles) {
+		nThreads = nFiles;
+	}
+
+	job.files = files;
+	job.nFiles = nFiles;
+	job.nextFile = 0;
+	job.merged = 0;
+	job.window = 2 * nThreads;
+	job.parsed = callocOrExit(nFiles, sizeof(char));
+	job.pairs = callocOrExit(nFiles, sizeof(struct pairTable));
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.changed, NULL);
+
+	struct ingestWorker *workers = callocOrExit(nThreads, sizeof(struct ingestWorker));
+
+	for (int t = 0; t < nThreads; t++) {
+		workers[t].job = &job;
+		if (pthread_create(&workers[t].thread, NULL, ingestThread, &workers[t]) != 0) {
+			fprintf(stderr, "Could Not Start Thread.\n");
+			exit(1);
+		}
+	}
+
+	for (int f = 0; f < nFiles; f++) {
+		pthread_mutex_lock(&job.lock);
+		while (!job.parsed[f]) {
+			pthread_cond_wait(&job.changed, &job.lock);
+		}
+		pthread_mutex_unlock(&job.lock);
+
+		mergePairTable(&job.pairs[f]);
+
+		pthread_mutex_lock(&job.lock);
+		job.merged = f + 1;
+		pthread_cond_broadcast(&job.changed);
+		pthread_mutex_unlock(&job.lock);
+	}
+	for (int t = 0; t < nThreads; t++) {
+		pthread_join(workers[t].thread, NULL);
+		errSeen += workers[t].errSeen;
+	}
+
+	pthread_cond_destroy(&job.changed);
+	pthread_mutex_destroy(&job.lock);
+	free(job.parsed);
+	free(job.pairs);
+	free(workers);
+	return errSeen;
+}
+
+
+
+/*
+* labelComponents(g) -- labels the connected components of g with one BFS
+* sweep over its CSR arrays. Components are numbered 0, 1, ... in the order
+* of their lowest node id; g->component and g->nComponents receive the result.
+* Side effects: exits if memory runs out.
+*/
+void labelComponents(struct csrGraph *g) {
+	uint32_t *queue = mallocOrExit((size_t) g->nNodes * sizeof(uint32_t) + 1);
+
+	g->component = mallocOrExit((size_t) g->nNodes * sizeof(uint32_t) + 1);
+	memset(g->component, 0xff, (size_t) g->nNodes * sizeof(uint32_t));  // UINT32_MAX = unlabeled
+	g->nComponents = 0;
+
+	for (uint32_t start = 0; start < g->nNodes; start++) {
+		if (g->component[start] != UINT32_MAX) {
+			continue;
+		}
+		uint32_t label = g->nComponents++;
+		uint32_t head = 0, tail = 0;
+		g->component[start] = label;
+		queue[tail++] = start;
+		while (head < tail) {
+			uint32_t A = queue[head++];
+			for (size_t e = g->offsets[A]; e < g->offsets[A + 1]; e++) {
+				if (g->component[g->adj[e]] == UINT32_MAX) {
+					g->component[g->adj[e]] = label;
+					queue[tail++] = g->adj[e];
+				}
+			}
+		}
+	}
+	free(queue);
+}
+
+
+
+/*
+* printComponentStats(out, g) -- writes how many connected components g has,
+* the largest one and how many components fall in each power-of-two size
+* range.
+*/
+void printComponentStats(FILE *out, struct csrGraph *g) {
+	uint32_t *sizes = callocOrExit((size_t) g->nComponents + 1, sizeof(uint32_t));
+	size_t histogram[33] = { 0 };
+	uint32_t largest = 0;
+
+	for (uint32_t id = 0; id < g->nNodes; id++) {
+		sizes[g->component[id]]++;
+	}
+	for (uint32_t c = 0; c < g->nComponents; c++) {
+		if (sizes[c] > largest) {
+			largest = sizes[c];
+		}
+		histogram[31 - __builtin_clz(sizes[c])]++;
+	}
+	free(sizes);
+
+	fprintf(out, "Components: %u, largest %u numbers\n", g->nComponents, largest);
+	for (int b = 0; b < 33; b++) {
+		if (histogram[b] != 0) {
+			fprintf(out, "  %llu-%llu numbers: %zu components\n", 1ULL << b,
+				(2ULL << b) - 1, histogram[b]);
+		}
+	}
+}
+
+
+
+/*
+* freezeGraph() -- builds a csrGraph from headLL and the nodes' calls arrays.
+* Node ids follow the order of headLL, and each node's neighbors keep the
+* order of its calls array. Components are labeled as part of the freeze.
+* Returns: the new graph; the caller releases it with freeCsrGraph.
+* Side effects: clears graphDirty; exits if memory runs out.
+*/
+struct csrGraph *freezeGraph() {
+	struct csrGraph *g = mallocOrExit(sizeof(struct csrGraph));
+	uint32_t n = nodeCount;
+
+	g->nNodes = n;
+	g->keys = mallocOrExit(n * sizeof(uint64_t));
+	g->offsets = mallocOrExit((n + 1) * sizeof(uint64_t));
+	g->index = NULL;
+	g->indexCap = 0;
+	g->mapping = NULL;
+	g->mappingSize = 0;
+	g->version = 0;
+
+	// First pass: degrees become offsets.
+	size_t total = 0;
+	for (struct phoneNode *cur = headLL; cur != NULL; cur = cur->next) {
+		g->keys[cur->id] = cur->key;
+		g->offsets[cur->id] = total;
+		total += cur->degree;
+	}
+	g->offsets[n] = total;
+	g->nEntries = total;
+
+	// Second pass: copy the neighbors and their call counts.
+	g->adj = mallocOrExit(total * sizeof(uint32_t));
+	g->calls = mallocOrExit(total * sizeof(int));
+	for (struct phoneNode *cur = headLL; cur != NULL; cur = cur->next) {
+		size_t pos = g->offsets[cur->id];
+		for (uint32_t i = 0; i < cur->degree; i++) {
+			g->adj[pos] = edgeOther(cur->calls[i], cur)->id;
+			g->calls[pos] = cur->calls[i]->totalCalls;
+			pos++;
+		}
+	}
+
+	labelComponents(g);
+	graphDirty = 0;
+	return g;
+}
+
+
+
+/*
+* freeCsrGraph(g) -- releases every array of g, including a number table
+* built by publishGraph (or unmaps the snapshot they point into) and g
+* itself. g may be NULL.
+*/
+void freeCsrGraph(struct csrGraph *g) {
+	if (g == NULL) {
+		return;
+	}
+	if (g->mapping != NULL) {
+		munmap(g->mapping, g->mappingSize);
+		free(g);
+		return;
+	}
+	free(g->keys);
+	free(g->offsets);
+	free(g->adj);
+	free(g->calls);
+	free(g->component);
+	free(g->index);
+	free(g);
+}
+
+
+
+/*
+* padTo8(size) -- rounds a section size up to the 8-byte boundary that
+* separates the sections of a snapshot.
+*/
+size_t padTo8(size_t size) {
+	return (size + 7) & ~(size_t) 7;
+}
+
+
+
+/*
+* writeSection(out, data, size) -- writes the size bytes at data followed by
+* zeros up to padTo8(size).
+* Returns: 0 on success, 1 if a write failed.
+*/
+int writeSection(FILE *out, const void *data, size_t size) {
+	static const char zeros[8] = { 0 };
+	size_t pad = padTo8(size) - size;
+
+	if (size > 0 && fwrite(data, 1, size, out) != size) {
+		return 1;
+	}
+	if (pad > 0 && fwrite(zeros, 1, pad, out) != pad) {
+		return 1;
+	}
+	return 0;
+}
+
+
+
+/*
+* buildNumberTable(g, cap) -- builds the number -> id table of g that a
+* snapshot stores, kept under the same load limit as phoneIdx.
+* Returns: the malloc'ed table; its number of slots goes to *cap.
+*/
+struct snapshotSlot *buildNumberTable(struct csrGraph *g, uint64_t *cap) {
+	uint64_t n = INDEX_INITIAL_CAPACITY;
+	while ((uint64_t) g->nNodes * INDEX_MAX_LOAD_DEN > n * INDEX_MAX_LOAD_NUM) {
+		n *= 2;
+	}
+
+	struct snapshotSlot *index = mallocOrExit(n * sizeof(struct snapshotSlot));
+	for (uint64_t i = 0; i < n; i++) {
+		index[i].key = 0;
+		index[i].id = SNAPSHOT_EMPTY;
+		index[i].unused = 0;
+	}
+	for (uint32_t id = 0; id < g->nNodes; id++) {
+		uint64_t pos = hashKey(g->keys[id]) & (n - 1);
+		while (index[pos].id != SNAPSHOT_EMPTY) {
+			pos = (pos + 1) & (n - 1);
+		}
+		index[pos].key = g->keys[id];
+		index[pos].id = id;
+	}
+	*cap = n;
+	return index;
+}
+
+
+
+/*
+* saveSnapshot(g, path) -- writes g to path in the snapshot format described
+* at snapshotHeader. The number -> id table is built here (buildNumberTable),
+* so loadSnapshot has nothing to rebuild.
+* The data goes to path.tmp first and is renamed over path once complete, so
+* an existing snapshot (even the one g was loaded from) is replaced atomically.
+* Returns: 0 on success, 1 if the file could not be written (an error
+* message has been printed to stderr).
+*/
+int saveSnapshot(struct csrGraph *g, const char *path) {
+	struct snapshotHeader h;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	h.version = SNAPSHOT_VERSION;
+	h.nNodes = g->nNodes;
+	h.nEntries = g->nEntries;
+	h.nComponents = g->nComponents;
+	struct snapshotSlot *index = buildNumberTable(g, &h.indexCap);
+
+	size_t pathLen = strlen(path);
+	char *tmpPath = mallocOrExit(pathLen + sizeof(".tmp"));
+	memcpy(tmpPath, path, pathLen);
+	memcpy(tmpPath + pathLen, ".tmp", sizeof(".tmp"));
+
+	FILE *out = fopen(tmpPath, "wb");
+	if (out == NULL) {
+		free(index);
+		free(tmpPath);
+		fprintf(stderr, "Could Not Write Snapshot.\n");
+		return 1;
+	}
+
+	int failed = fwrite(&h, sizeof(h), 1, out) != 1;
+	failed |= writeSection(out, g->keys, (size_t) g->nNodes * sizeof(uint64_t));
+	failed |= writeSection(out, g->offsets, ((size_t) g->nNodes + 1) * sizeof(uint64_t));
+	failed |= writeSection(out, index, h.indexCap * sizeof(struct snapshotSlot));
+	failed |= writeSection(out, g->adj, g->nEntries * sizeof(uint32_t));
+	failed |= writeSection(out, g->calls, g->nEntries * sizeof(int));
+	failed |= writeSection(out, g->component, (size_t) g->nNodes * sizeof(uint32_t));
+	failed |= fclose(out) != 0;
+	free(index);
+
+	if (failed || rename(tmpPath, path) != 0) {
+		unlink(tmpPath);
+		free(tmpPath);
+		fprintf(stderr, "Could Not Write Snapshot.\n");
+		return 1;
+	}
+	free(tmpPath);
+	return 0;
+}
+
+
+
+/*
+* thawGraph(g) -- rebuilds the phoneNode / edges graph from g (normally a
+* loaded snapshot) through findOrAddNode and addEdges, so more files can be
+* parsed on top of it. Nodes are added in id order and keep their ids; each
+* undirected edge is added once, from its lower-id end, with its whole call
+* count. Assumes the linked-list graph is empty.
+*/
+void thawGraph(struct csrGraph *g) {
+	struct phoneNode **nodes = mallocOrExit((size_t) g->nNodes * sizeof(struct phoneNode *));
+
+	for (uint32_t id = 0; id < g->nNodes; id++) {
+		nodes[id] = findOrAddNode(g->keys[id]);
+	}
+	for (uint32_t u = 0; u < g->nNodes; u++) {
+		for (size_t e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+			if (g->adj[e] >= u) {
+				addEdges(nodes[u], nodes[g->adj[e]], g->calls[e]);
+			}
+		}
+	}
+	free(nodes);
+}
+
+
+
+/*
+* snapshotArraysValid(g) -- checks the arrays of a just mapped snapshot
+* before anything indexes with them: offsets never decrease and end at
+* nEntries, every adj entry and every used index slot names a node below
+* nNodes, every component label is below nComponents, and the index keeps at
+* least one empty slot so lookups terminate.
+* One pass over each array; a damaged file must not crash a query later.
+* Returns: 1 if g can be used, 0 otherwise.
+*/
+int snapshotArraysValid(struct csrGraph *g) {
+	for (uint32_t u = 0; u < g->nNodes; u++) {
+		if (g->offsets[u] > g->offsets[u + 1]) {
+			return 0;
+		}
+	}
+	if (g->offsets[0] != 0 || g->offsets[g->nNodes] != g->nEntries) {
+		return 0;
+	}
+	for (size_t e = 0; e < g->nEntries; e++) {
+		if (g->adj[e] >= g->nNodes) {
+			return 0;
+		}
+	}
+	for (uint32_t u = 0; u < g->nNodes; u++) {
+		if (g->component[u] >= g->nComponents) {
+			return 0;
+		}
+	}
+
+	uint64_t used = 0;
+	for (uint64_t i = 0; i < g->indexCap; i++) {
+		if (g->index[i].id != SNAPSHOT_EMPTY) {
+			if (g->index[i].id >= g->nNodes) {
+				return 0;
+			}
+			used++;
+		}
+	}
+	return used < g->indexCap;
+}
+
+
+
+/*
+* loadSnapshot(path) -- maps a file written by saveSnapshot and returns a
+* csrGraph whose arrays point straight into the mapping, so nothing is
+* parsed or copied. Snapshots are not trusted: besides the header and the
+* section sizes, every node id in the file is range checked
+* (snapshotArraysValid), which reads each section once.
+* Returns: the graph (released with freeCsrGraph), or NULL if the file can't
+* be opened or is not a snapshot of this version (a message has been printed).
+*/
+struct csrGraph *loadSnapshot(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Could Not Open File.\n");
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct snapshotHeader)) {
+		close(fd);
+		fprintf(stderr, "Invalid Snapshot.\n");
+		return NULL;
+	}
+	size_t size = st.st_size;
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Could Not Open File.\n");
+		return NULL;
+	}
+
+	struct snapshotHeader *h = (struct snapshotHeader *) data;
+	int valid = memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+		&& h->version == SNAPSHOT_VERSION
+		&& h->nComponents <= h->nNodes
+		// The probe loops need a power-of-two table with at least one empty slot.
+		&& h->indexCap > h->nNodes && (h->indexCap & (h->indexCap - 1)) == 0
+		&& h->indexCap <= size / sizeof(struct snapshotSlot)
+		&& h->nEntries <= size / sizeof(uint32_t);
+
+	size_t keysAt = sizeof(struct snapshotHeader);
+	size_t offsetsAt = keysAt + padTo8((size_t) h->nNodes * sizeof(uint64_t));
+	size_t indexAt = offsetsAt + padTo8(((size_t) h->nNodes + 1) * sizeof(uint64_t));
+	size_t adjAt = indexAt + h->indexCap * sizeof(struct snapshotSlot);
+	size_t callsAt = adjAt + padTo8(h->nEntries * sizeof(uint32_t));
+	size_t componentAt = callsAt + padTo8(h->nEntries * sizeof(int));
+	size_t end = componentAt + padTo8((size_t) h->nNodes * sizeof(uint32_t));
+
+	if (!valid || end != size || ((uint64_t *) (data + offsetsAt))[h->nNodes] != h->nEntries) {
+		munmap(data, size);
+		fprintf(stderr, "Invalid Snapshot.\n");
+		return NULL;
+	}
+
+	struct csrGraph *g = mallocOrExit(sizeof(struct csrGraph));
+	g->nNodes = h->nNodes;
+	g->nEntries = h->nEntries;
+	g->keys = (uint64_t *) (data + keysAt);
+	g->offsets = (uint64_t *) (data + offsetsAt);
+	g->index = (struct snapshotSlot *) (data + indexAt);
+	g->indexCap = h->indexCap;
+	g->adj = (uint32_t *) (data + adjAt);
+	g->calls = (int *) (data + callsAt);
+	g->component = (uint32_t *) (data + componentAt);
+	g->nComponents = h->nComponents;
+	g->mapping = data;
+	g->mappingSize = size;
+	g->version = 0;
+
+	if (!snapshotArraysValid(g)) {
+		freeCsrGraph(g);
+		fprintf(stderr, "Invalid Snapshot.\n");
+		return NULL;
+	}
+	return g;
+}
+
+
+
+/*
+* reserveScratch(s, nNodes) -- makes sure s can run a BFS over nNodes nodes,
+* reallocating its arrays only when the graph outgrew them. A scratch that
+* has to grow at least doubles, so a graph that keeps gaining nodes between
+* queries (--stream) only reallocates now and then.
+*/
+void reserveScratch(struct bfsScratch *s, uint32_t nNodes) {
+	if (s->capacity >= nNodes && s->frontier != NULL) {
+		return;
+	}
+	if (s->frontier != NULL && nNodes / 2 < s->capacity) {
+		nNodes = s->capacity * 2;
+	}
+	free(s->frontier);
+	free(s->backFrontier);
+	free(s->level);
+	free(s->mark);
+	free(s->parent);
+	free(s->path);
+	free(s->strength);
+	s->capacity = nNodes;
+	s->frontier = mallocOrExit((size_t) nNodes * sizeof(uint32_t) + 1);
+	s->backFrontier = mallocOrExit((size_t) nNodes * sizeof(uint32_t) + 1);
+	s->level = mallocOrExit((size_t) nNodes * sizeof(int) + 1);
+	s->parent = mallocOrExit((size_t) nNodes * sizeof(uint32_t) + 1);
+	s->path = mallocOrExit((size_t) nNodes * sizeof(uint32_t) + 1);
+	s->strength = strongestMode ? mallocOrExit((size_t) nNodes * sizeof(int) + 1) : NULL;
+	s->mark = callocOrExit((size_t) nNodes + 1, sizeof(uint32_t));
+	s->epoch = 0;
+}
+
+
+
+/*
+* startSearch(s) -- begins a new search on s by moving to the next epoch, so
+* every mark left by earlier searches reads as "not queued". The marks are
+* only cleared when the 32-bit epoch wraps around.
+* Returns: the epoch of the new search.
+*/
+uint32_t startSearch(struct bfsScratch *s) {
+	s->epoch++;
+	if (s->epoch == 0) {
+		memset(s->mark, 0, (size_t) s->capacity * sizeof(uint32_t));
+		s->epoch = 1;
+	}
+	return s->epoch;
+}
+
+
+
+/*
+* freeScratch(s) -- releases the arrays of s and resets it to empty.
+*/
+void freeScratch(struct bfsScratch *s) {
+	free(s->frontier);
+	free(s->backFrontier);
+	free(s->level);
+	free(s->mark);
+	free(s->parent);
+	free(s->path);
+	free(s->strength);
+	s->capacity = 0;
+	s->frontier = NULL;
+	s->backFrontier = NULL;
+	s->level = NULL;
+	s->mark = NULL;
+	s->parent = NULL;
+	s->path = NULL;
+	s->strength = NULL;
+	s->epoch = 0;
+}
+
+
+
+/*
+* currentGraph() -- returns frozenGraph, re-freezing it first if the
+* linked-list graph was modified since the last freeze.
+*/
+struct csrGraph *currentGraph() {
+	if (graphDirty || frozenGraph == NULL) {
+		freeCsrGraph(frozenGraph);
+		frozenGraph = freezeGraph();
+		graphVersion++;
+	}
+	return frozenGraph;
+}
+
+
+
+/*
+* retiredGraph -- a graph publishGraph replaced, waiting until no reader can
+* still be using it. epoch: the value of liveEpoch once it was replaced.
+*/
+struct retiredGraph {
+	struct csrGraph *g;
+	unsigned long epoch;
+	struct retiredGraph *next;
+};
+
+// --live: the graph queries run on. Only the writer replaces it, with a new
+// frozen copy; a published graph is never modified, so readers need no locks.
+_Atomic(struct csrGraph *) liveGraph = NULL;
+// Bumped after each replacement of liveGraph; starts at 1 so that 0 can mean
+// "not reading" in liveReaderEpochs.
+atomic_ulong liveEpoch = 1;
+// One slot per reader thread (0: the main query thread, 1..N: the -q batch
+// threads): liveEpoch as it was when that reader pinned liveGraph, 0 between
+// queries. Set up by startLiveIngest.
+atomic_ulong *liveReaderEpochs = NULL;
+int liveReaders = 0;
+// Graphs replaced but not yet freed; only the writer touches this list.
+struct retiredGraph *retiredGraphs = NULL;
+
+
+
+/*
+* reclaimGraphs() -- frees the retired graphs no reader can still hold.
+* A reader that pinned with an epoch at least a graph's retirement epoch
+* loaded liveGraph after that graph was replaced, so it has a newer one;
+* the oldest epoch pinned by any reader decides for all of them.
+*/
+void reclaimGraphs() {
+	unsigned long oldest = 0;
+	struct retiredGraph **link = &retiredGraphs;
+
+	for (int i = 0; i < liveReaders; i++) {
+		unsigned long pinned = atomic_load(&liveReaderEpochs[i]);
+		if (pinned != 0 && (oldest == 0 || pinned < oldest)) {
+			oldest = pinned;
+		}
+	}
+	while (*link != NULL) {
+		struct retiredGraph *r = *link;
+		if (oldest == 0 || oldest >= r->epoch) {
+			*link = r->next;
+			freeCsrGraph(r->g);
+			free(r);
+		} else {
+			link = &r->next;
+		}
+	}
+}
+
+
+
+/*
+* publishGraph() -- (--live writer) freezes the graph parsed so far, gives
+* it its own number table so readers never touch phoneIdx while the writer
+* grows it, and makes it the graph new queries see. The graph it replaces is
+* freed once the readers are done with it (reclaimGraphs).
+* A publish costs O(numbers + adjacency entries), so the next one waits for
+* at least half as many new lines as the graph has entries: the rebuilds
+* then add up to a constant factor over the ingest itself, however big the
+* load gets.
+*/
+void publishGraph() {
+	struct csrGraph *g = freezeGraph();
+	size_t wait = g->nEntries / 2;
+
+	liveNextPublish = liveLines + (wait > LIVE_PUBLISH_MIN_LINES ? wait : LIVE_PUBLISH_MIN_LINES);
+
+	g->index = buildNumberTable(g, &g->indexCap);
+	g->version = atomic_load(&liveEpoch) + 1;
+
+	struct csrGraph *old = atomic_exchange(&liveGraph, g);
+	unsigned long epoch = atomic_fetch_add(&liveEpoch, 1) + 1;
+	if (old != NULL) {
+		struct retiredGraph *r = mallocOrExit(sizeof(struct retiredGraph));
+		r->g = old;
+		r->epoch = epoch;
+		r->next = retiredGraphs;
+		retiredGraphs = r;
+	}
+	reclaimGraphs();
+}
+
+
+
+/*
+* pinLiveGraph(reader) -- (--live query thread) returns the latest published
+* graph, which stays valid until the same reader slot calls unpinLiveGraph.
+* Each thread pins through a slot of its own, so readers come and go
+* independently of each other.
+*/
+struct csrGraph *pinLiveGraph(int reader) {
+	atomic_store(&liveReaderEpochs[reader], atomic_load(&liveEpoch));
+	return atomic_load(&liveGraph);
+}
+
+
+
+/*
+* unpinLiveGraph(reader) -- ends the use of the graph the reader slot pinned.
+*/
+void unpinLiveGraph(int reader) {
+	atomic_store(&liveReaderEpochs[reader], 0);
+}
+
+
+
+/*
+* liveIngest -- the --live writer thread and the files it parses.
+* errSeen: parse errors, as parseFile returns them.
+* started / seconds: clockSeconds() at the start, and the time taken to parse
+*                    everything (with the graphs published along the way).
+*/
+struct liveIngest {
+	pthread_t thread;
+	char **files;
+	int nFiles;
+	int errSeen;
+	double started;
+	double seconds;
+};
+
+
+
+/*
+* liveIngestThread(arg) -- parses the files of the liveIngest at arg one after
+* another (publishing along the way, see parseBuffer), then publishes the
+* complete graph.
+*/
+void *liveIngestThread(void *arg) {
+	struct liveIngest *live = arg;
+
+	for (int i = 0; i < live->nFiles; i++) {
+		live->errSeen += parseFile(live->files[i]);
+	}
+	live->seconds = clockSeconds() - live->started;
+	publishGraph();
+	return NULL;
+}
+
+
+
+/*
+* startLiveIngest(live, nReaders) -- sets up a pin slot for each of nReaders
+* query threads, publishes the graph as it is now (empty, or a thawed
+* snapshot) so queries can start at once, then starts the writer.
+*/
+void startLiveIngest(struct liveIngest *live, int nReaders) {
+	liveReaderEpochs = callocOrExit(nReaders, sizeof(atomic_ulong));
+	liveReaders = nReaders;
+	publishGraph();
+	live->errSeen = 0;
+	live->started = clockSeconds();
+	if (pthread_create(&live->thread, NULL, liveIngestThread, live) != 0) {
+		fprintf(stderr, "Could Not Start Thread.\n");
+		exit(1);
+	}
+}
+
+
+
+/*
+* finishLiveIngest(live) -- waits for the writer, then makes its final graph
+* frozenGraph and frees the retired ones; the program carries on as if the
+* files had been parsed up front.
+* Returns: the writer's parse error count.
+*/
+int finishLiveIngest(struct liveIngest *live) {
+	pthread_join(live->thread, NULL);
+	liveMode = 0;
+	frozenGraph = atomic_exchange(&liveGraph, NULL);
+	reclaimGraphs();
+	free(liveReaderEpochs);
+	liveReaderEpochs = NULL;
+	liveReaders = 0;
+	return live->errSeen;
+}
+
+
+
+/*
+* graphFindNode(g, key, id) -- finds the node id of the packed number key in
+* g, through the snapshot's table when g was loaded from one and through
+* phoneIdx otherwise.
+* Returns: 0 and sets *id if the number is in g, 1 if it isn't.
+*/
+int graphFindNode(struct csrGraph *g, uint64_t key, uint32_t *id) {
+	if (g->index == NULL) {
+		struct phoneNode *p = indexLookup(key);
+		if (p == NULL) {
+			return 1;
+		}
+		*id = p->id;
+		return 0;
+	}
+
+	uint64_t mask = g->indexCap - 1;
+	uint64_t pos = hashKey(key) & mask;
+	while (g->index[pos].id != SNAPSHOT_EMPTY) {
+		if (g->index[pos].key == key) {
+			*id = g->index[pos].id;
+			return 0;
+		}
+		pos = (pos + 1) & mask;
+	}
+	return 1;
+}
+
+
+
+/*
+* BFS(g, s, start, target) -- returns the number of intermediate nodes on the
+* shortest path between node ids start and target in the frozen graph g,
+* using a breadth-first search over its CSR arrays. The frontier and per-node
+* state live in the scratch s, which must be reserved for g->nNodes.
+* Returns -1 if no path exists.
+*/
+int BFS(struct csrGraph *g, struct bfsScratch *s, uint32_t start, uint32_t target) {
+    
+	// A new epoch marks every node as not queued without touching them.
+	uint32_t epoch = startSearch(s);
+	s->mark[start] = epoch;
+	s->level[start] = 0;
+
+	uint32_t head = 0, tail = 0;
+	s->frontier[tail++] = start;  // Enqueue start node
+
+	while (head < tail) {
+		uint32_t A = s->frontier[head++];
+		if (A == target) {
+			s->meetFwd = target;
+			s->meetBack = NO_NODE;
+			s->visited = tail;
+			return s->level[A] - 1;  // Subtract 1 to exclude the start node
+		}
+		for (size_t e = g->offsets[A]; e < g->offsets[A + 1]; e++) {
+			uint32_t child = g->adj[e];
+			if (s->mark[child] != epoch) {
+				s->mark[child] = epoch;
+				s->level[child] = s->level[A] + 1;
+				s->parent[child] = A;
+				s->frontier[tail++] = child;
+			}
+		}
+	}
+	s->visited = tail;
+	return -1;  // Return -1 if no connection is found
+}
+
+
+
+/*
+* reachNeighbor(s, queue, tail, A, child, mine, other, best, meetMine, meetOther)
+* -- one step of expandLevel: node A of side mine looks at its neighbor child.
+* Returns: best, lowered (with *meetMine / *meetOther updated) when child
+* belongs to side other and closes a shorter path.
+*/
+int reachNeighbor(struct bfsScratch *s, uint32_t *queue, uint32_t *tail, uint32_t A,
+		uint32_t child, uint32_t mine, uint32_t other, int best,
+		uint32_t *meetMine, uint32_t *meetOther) {
+	if (s->mark[child] == other) {
+		int length = s->level[A] + 1 + s->level[child];
+		if (best == -1 || length < best) {
+			*meetMine = A;
+			*meetOther = child;
+			return length;
+		}
+	} else if (s->mark[child] != mine) {
+		s->mark[child] = mine;
+		s->level[child] = s->level[A] + 1;
+		s->parent[child] = A;
+		queue[(*tail)++] = child;
+	}
+	return best;
+}
+
+
+
+/*
+* expandLevel(g, s, queue, head, tail, mine, other, meetMine, meetOther) --
+* expands one whole BFS level for one side of bidirectionalBFS: every node in
+* queue[*head .. *tail) queues its unvisited neighbors (marked with epoch
+* mine) at the end of queue. Neighbors already marked with epoch other belong
+* to the opposite search. g is the frozen graph, or NULL to walk the live
+* phoneNode graph (nodesById and each node's calls array).
+* Returns: the shortest path length (in edges) through any such meeting
+* point, or -1 if the two searches did not meet on this level. The edge of
+* that path that joins the sides goes to *meetMine / *meetOther.
+* Side effects: advances *head past the expanded level and *tail past the
+* newly queued nodes.
+*/
+int expandLevel(struct csrGraph *g, struct bfsScratch *s, uint32_t *queue,
+		uint32_t *head, uint32_t *tail, uint32_t mine, uint32_t other,
+		uint32_t *meetMine, uint32_t *meetOther) {
+	int best = -1;
+	uint32_t levelEnd = *tail;
+
+	for (uint32_t i = *head; i < levelEnd; i++) {
+		uint32_t A = queue[i];
+		if (g != NULL) {
+			for (size_t e = g->offsets[A]; e < g->offsets[A + 1]; e++) {
+				best = reachNeighbor(s, queue, tail, A, g->adj[e], mine, other, best,
+					meetMine, meetOther);
+			}
+		} else {
+			struct phoneNode *p = nodesById[A];
+			for (uint32_t k = 0; k < p->degree; k++) {
+				best = reachNeighbor(s, queue, tail, A, edgeOther(p->calls[k], p)->id,
+					mine, other, best, meetMine, meetOther);
+			}
+		}
+	}
+	*head = levelEnd;
+	return best;
+}
+
+
+
+/*
+* bidirectionalBFS(g, s, start, target) -- same result as BFS (number of
+* intermediate nodes on a shortest path, -1 if none), but searches from both
+* ends at once. Each round expands a full level of whichever side has the
+* smaller frontier, and the search stops on the first level where the two
+* sides meet, so it usually explores far less of a dense graph than BFS.
+* With g == NULL it searches the live phoneNode graph (see expandLevel).
+*/
+int bidirectionalBFS(struct csrGraph *g, struct bfsScratch *s, uint32_t start, uint32_t target) {
+	if (start == target) {
+		s->visited = 0;
+		return -1;  // BFS reports -1 (level 0 - 1) for a number and itself
+	}
+
+	uint32_t fwd = startSearch(s);
+	uint32_t back = startSearch(s);
+	uint32_t fHead = 0, fTail = 0, bHead = 0, bTail = 0;
+
+	s->mark[start] = fwd;
+	s->level[start] = 0;
+	s->frontier[fTail++] = start;
+	s->mark[target] = back;
+	s->level[target] = 0;
+	s->backFrontier[bTail++] = target;
+
+	// Once either side runs dry, its whole component has been seen.
+	while (fHead < fTail && bHead < bTail) {
+		int length;
+		if (fTail - fHead <= bTail - bHead) {
+			length = expandLevel(g, s, s->frontier, &fHead, &fTail, fwd, back,
+				&s->meetFwd, &s->meetBack);
+		} else {
+			length = expandLevel(g, s, s->backFrontier, &bHead, &bTail, back, fwd,
+				&s->meetBack, &s->meetFwd);
+		}
+		if (length != -1) {
+			s->visited = fTail + bTail;
+			return length - 1;  // Subtract 1 to exclude the start node
+		}
+	}
+	s->visited = fTail + bTail;
+	return -1;  // Return -1 if no connection is found
+}
+
+
+
+/*
+* tracePath(s) -- writes the shortest path found by the last successful BFS or
+* bidirectionalBFS on s into s->path, start first and target last: the start
+* side is followed back from meetFwd through parent, then the target side
+* (if any) forward from meetBack. Costs O(path length).
+* Returns: the number of nodes on the path.
+*/
+uint32_t tracePath(struct bfsScratch *s) {
+	uint32_t n = s->level[s->meetFwd] + 1;
+	uint32_t x = s->meetFwd;
+
+	for (uint32_t i = n - 1; ; i--) {
+		s->path[i] = x;
+		if (i == 0) {
+			break;
+		}
+		x = s->parent[x];
+	}
+	if (s->meetBack != NO_NODE) {
+		for (x = s->meetBack; ; x = s->parent[x]) {
+			s->path[n++] = x;
+			if (s->level[x] == 0) {
+				break;
+			}
+		}
+	}
+	return n;
+}
+
+
+
+/*
+* heapSiftUp(s, i) -- moves the node at position i of strongestPath's heap
+* (s->frontier, a 4-ary max-heap on s->strength) up to where it belongs,
+* keeping the positions in s->backFrontier current.
+*/
+void heapSiftUp(struct bfsScratch *s, uint32_t i) {
+	uint32_t node = s->frontier[i];
+	int key = s->strength[node];
+
+	while (i > 0) {
+		uint32_t up = (i - 1) / 4;
+		if (s->strength[s->frontier[up]] >= key) {
+			break;
+		}
+		s->frontier[i] = s->frontier[up];
+		s->backFrontier[s->frontier[i]] = i;
+		i = up;
+	}
+	s->frontier[i] = node;
+	s->backFrontier[node] = i;
+}
+
+
+
+/*
+* heapSiftDown(s, i, size) -- moves the node at position i of a heap of size
+* nodes down to where it belongs (see heapSiftUp).
+*/
+void heapSiftDown(struct bfsScratch *s, uint32_t i, uint32_t size) {
+	uint32_t node = s->frontier[i];
+	int key = s->strength[node];
+
+	for (;;) {
+		uint32_t first = 4 * i + 1;
+		if (first >= size) {
+			break;
+		}
+		uint32_t last = first + 4 < size ? first + 4 : size;
+		uint32_t best = first;
+		for (uint32_t c = first + 1; c < last; c++) {
+			if (s->strength[s->frontier[c]] > s->strength[s->frontier[best]]) {
+				best = c;
+			}
+		}
+		if (s->strength[s->frontier[best]] <= key) {
+			break;
+		}
+		s->frontier[i] = s->frontier[best];
+		s->backFrontier[s->frontier[i]] = i;
+		i = best;
+	}
+	s->frontier[i] = node;
+	s->backFrontier[node] = i;
+}
+
+
+
+/*
+* strongestPath(g, s, start, target) -- finds the path between node ids start
+* and target of g whose weakest link has the most calls (the widest path),
+* with Dijkstra's algorithm on call counts: nodes leave a 4-ary max-heap in
+* order of the weakest call count on the best path to them, and the search
+* stops when target leaves it. The heap holds each node at most once (a
+* better path moves the node up instead of adding it again), so it fits in
+* s->frontier and nothing is allocated per query. Each reached node's parent
+* and hop count are kept so tracePath can recover the path.
+* Returns: that weakest call count, or -1 if target can't be reached from
+* start (or is start).
+*/
+int strongestPath(struct csrGraph *g, struct bfsScratch *s, uint32_t start, uint32_t target) {
+	uint32_t epoch = startSearch(s);
+	uint32_t size = 0;
+
+	s->visited = 0;
+	if (start == target) {
+		return -1;
+	}
+
+	s->mark[start] = epoch;
+	s->strength[start] = INT_MAX;
+	s->level[start] = 0;
+	s->frontier[size++] = start;
+	s->backFrontier[start] = 0;
+
+	while (size > 0) {
+		uint32_t A = s->frontier[0];
+		s->backFrontier[A] = NO_NODE;  // Settled: its strength is final.
+		s->visited++;
+		if (--size > 0) {
+			s->frontier[0] = s->frontier[size];
+			heapSiftDown(s, 0, size);
+		}
+
+		if (A == target) {
+			s->meetFwd = target;
+			s->meetBack = NO_NODE;
+			return s->strength[target];
+		}
+
+		for (size_t e = g->offsets[A]; e < g->offsets[A + 1]; e++) {
+			uint32_t child = g->adj[e];
+			int through = g->calls[e] < s->strength[A] ? g->calls[e] : s->strength[A];
+
+			if (s->mark[child] != epoch) {
+				s->mark[child] = epoch;
+				s->strength[child] = through;
+				s->level[child] = s->level[A] + 1;
+				s->parent[child] = A;
+				s->frontier[size] = child;
+				heapSiftUp(s, size++);
+			} else if (s->backFrontier[child] != NO_NODE && through > s->strength[child]) {
+				s->strength[child] = through;
+				s->level[child] = s->level[A] + 1;
+				s->parent[child] = A;
+				heapSiftUp(s, s->backFrontier[child]);
+			}
+		}
+	}
+	return -1;
+}
+
+
+
+/*
+* recordSearch(s, started) -- adds the search that just ran on s, which began
+* at clockSeconds() == started, to the BFS counters and latency histogram of
+* stats. Safe to call from several threads at once.
+*/
+void recordSearch(struct bfsScratch *s, double started) {
+	double micros = (clockSeconds() - started) * 1e6;
+	int bucket = 0;
+
+	while (bucket < LATENCY_BUCKETS - 1 && micros >= (double) (1u << bucket)) {
+		bucket++;
+	}
+	atomic_fetch_add_explicit(&stats.searchLatency[bucket], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats.searches, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats.nodesVisited, s->visited, memory_order_relaxed);
+
+	size_t max = atomic_load_explicit(&stats.maxVisited, memory_order_relaxed);
+	while (s->visited > max && !atomic_compare_exchange_weak(&stats.maxVisited, &max, s->visited)) {
+	}
+}
+
+
+
+/*
+* queryResult -- the answer to one connection query.
+* status: QUERY_NOT_FOUND, QUERY_TALKED, QUERY_CONNECTED, QUERY_NOT_CONNECTED
+*         or, with --strongest, QUERY_STRONGEST.
+* value: the call count for QUERY_TALKED, the number of intermediate numbers
+*        for QUERY_CONNECTED, the weakest link's call count for QUERY_STRONGEST.
+*/
+struct queryResult {
+	int status;
+	int value;
+};
+
+#define QUERY_NOT_FOUND 0
+#define QUERY_TALKED 1
+#define QUERY_CONNECTED 2
+#define QUERY_NOT_CONNECTED 3
+#define QUERY_STRONGEST 4
+
+
+
+/*
+* answerQuery(g, s, id1, id2) -- works out how node ids id1 and id2 of g are
+* connected: directly (the calls entry between them), through other numbers
+* (bidirectionalBFS, or BFS when oneSidedSearch is set) or not at all, which
+* is known without a search when they lie in different components. Only
+* reads g and writes s, so threads with their own scratch can answer queries
+* at once. s is reserved for g only when a search is needed, so direct calls
+* and other components are answered without touching it.
+* With --strongest two different numbers are always answered by strongestPath,
+* since the strongest connection may go around a weak direct call.
+*/
+struct queryResult answerQuery(struct csrGraph *g, struct bfsScratch *s, uint32_t id1, uint32_t id2) {
+	struct queryResult r = { QUERY_TALKED, 0 };
+
+	// With --strongest a direct call may be weaker than a detour, so only a
+	// number calling itself is answered here.
+	if (!strongestMode || id1 == id2) {
+		for (size_t e = g->offsets[id1]; e < g->offsets[id1 + 1]; e++) {
+			if (g->adj[e] == id2) {
+				r.value = g->calls[e];
+				return r;
+			}
+		}
+	}
+
+	// Numbers in different components can't be connected: no search needed.
+	if (g->component[id1] != g->component[id2]) {
+		r.status = QUERY_NOT_CONNECTED;
+		r.value = -1;
+		return r;
+	}
+
+	reserveScratch(s, g->nNodes);
+	double started = statsEnabled ? clockSeconds() : 0;
+	if (strongestMode) {
+		r.value = strongestPath(g, s, id1, id2);
+	} else if (oneSidedSearch) {
+		r.value = BFS(g, s, id1, id2);  // Perform BFS
+	} else {
+		r.value = bidirectionalBFS(g, s, id1, id2);
+	}
+	if (statsEnabled) {
+		recordSearch(s, started);
+	}
+	if (r.value == -1) {
+		r.status = QUERY_NOT_CONNECTED;
+	} else {
+		r.status = strongestMode ? QUERY_STRONGEST : QUERY_CONNECTED;
+	}
+	return r;
+}
+
+
+
+/*
+* printQueryResult(r) -- prints r the way the query loop always has:
+* "Talked n times", "Connected through n numbers" or "Not connected" on
+* stdout, "Phone Number Not Found." on stderr.
+*/
+void printQueryResult(struct queryResult r) {
+	if (r.status == QUERY_NOT_FOUND) {
+		fprintf(stderr, "Phone Number Not Found.\n");
+	} else if (r.status == QUERY_TALKED) {
+		printf("Talked %d times\n", r.value);
+	} else if (r.status == QUERY_CONNECTED) {
+		printf("Connected through %d numbers\n", r.value);
+	} else if (r.status == QUERY_STRONGEST) {
+		printf("Strongest connection: weakest link %d calls\n", r.value);
+	} else {
+		printf("Not connected\n");
+	}
+}
+
+
+
+/*
+* cacheEntry -- one answer kept by a queryCache, for the unordered pair of
+* packed numbers lo <= hi. Entries are linked by index (-1 ends a list):
+* version: graphVersion the answer was computed against; an entry from an
+*          older graph is never returned, only reused by cacheInsert.
+* chain: next entry in the same hash bucket.
+* newer / older: neighbors in the cache's recency list.
+*/
+struct cacheEntry {
+	uint64_t lo;
+	uint64_t hi;
+	unsigned long version;
+	struct queryResult result;
+	int chain;
+	int newer;
+	int older;
+};
+
+
+/*
+* queryCache -- bounded LRU cache of the answers printed by checkIfInGraph.
+* entries: capacity entries, the first count of them in use.
+* buckets: hash chains of entries (nBuckets is a power of two, -1 = empty).
+* newest / oldest: ends of the recency list; oldest is evicted when full.
+*                  Answers about an older graph just age out through it, so
+*                  a change to the graph (every "+" line of --stream) costs
+*                  nothing here.
+* hits / misses / evictions: running totals reported by --stats.
+*/
+struct queryCache {
+	struct cacheEntry *entries;
+	int capacity;
+	int count;
+	int *buckets;
+	size_t nBuckets;
+	int newest;
+	int oldest;
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+};
+
+#define QUERY_CACHE_DEFAULT 4096
+
+struct queryCache queryCache = { NULL, 0, 0, NULL, 0, -1, -1, 0, 0, 0 };
+
+// Number of answers queryCache may hold (--cache N, 0 turns it off).
+int queryCacheSize = QUERY_CACHE_DEFAULT;
+
+
+
+/*
+* cacheBucket(c, lo, hi) -- the bucket of c that the pair lo / hi hashes to.
+*/
+size_t cacheBucket(struct queryCache *c, uint64_t lo, uint64_t hi) {
+	return hashKey(lo * 0x9e3779b97f4a7c15ULL ^ hi) & (c->nBuckets - 1);
+}
+
+
+
+/*
+* cacheClear(c) -- forgets every answer in c, keeping its arrays and counters.
+*/
+void cacheClear(struct queryCache *c) {
+	for (size_t b = 0; b < c->nBuckets; b++) {
+		c->buckets[b] = -1;
+	}
+	c->count = 0;
+	c->newest = -1;
+	c->oldest = -1;
+}
+
+
+
+/*
+* cacheUnlink(c, i) -- takes entry i out of the recency list of c.
+*/
+void cacheUnlink(struct queryCache *c, int i) {
+	struct cacheEntry *e = &c->entries[i];
+
+	if (e->newer != -1) {
+		c->entries[e->newer].older = e->older;
+	} else {
+		c->newest = e->older;
+	}
+	if (e->older != -1) {
+		c->entries[e->older].newer = e->newer;
+	} else {
+		c->oldest = e->newer;
+	}
+}
+
+
+
+/*
+* cachePushNewest(c, i) -- puts entry i at the most recently used end of c.
+*/
+void cachePushNewest(struct queryCache *c, int i) {
+	c->entries[i].newer = -1;
+	c->entries[i].older = c->newest;
+	if (c->newest != -1) {
+		c->entries[c->newest].newer = i;
+	} else {
+		c->oldest = i;
+	}
+	c->newest = i;
+}
+
+
+
+/*
+* cacheFind(c, lo, hi) -- the entry of c for the pair lo <= hi, current or not.
+* Returns: its index, or -1.
+*/
+int cacheFind(struct queryCache *c, uint64_t lo, uint64_t hi) {
+	for (int i = c->buckets[cacheBucket(c, lo, hi)]; i != -1; i = c->entries[i].chain) {
+		if (c->entries[i].lo == lo && c->entries[i].hi == hi) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+
+/*
+* cacheLookup(c, p1, p2, result) -- looks for the answer to p1 / p2 (in
+* either order) on the current graph in c and marks it most recently used.
+* Returns: 1 and fills *result on a hit, 0 on a miss.
+*/
+int cacheLookup(struct queryCache *c, uint64_t p1, uint64_t p2, struct queryResult *result) {
+	if (c->capacity == 0) {
+		return 0;
+	}
+
+	uint64_t lo = p1 < p2 ? p1 : p2;
+	uint64_t hi = p1 < p2 ? p2 : p1;
+	int i = cacheFind(c, lo, hi);
+	if (i != -1 && c->entries[i].version == graphVersion) {
+		cacheUnlink(c, i);
+		cachePushNewest(c, i);
+		*result = c->entries[i].result;
+		c->hits++;
+		return 1;
+	}
+	c->misses++;
+	return 0;
+}
+
+
+
+/*
+* cacheInsert(c, p1, p2, result) -- remembers result as the answer to p1 / p2
+* on the current graph. An outdated answer for the pair is overwritten in
+* place; otherwise the least recently used answer is evicted when c is full.
+* Assumes cacheLookup just missed.
+*/
+void cacheInsert(struct queryCache *c, uint64_t p1, uint64_t p2, struct queryResult result) {
+	if (c->capacity == 0) {
+		return;
+	}
+
+	uint64_t lo = p1 < p2 ? p1 : p2;
+	uint64_t hi = p1 < p2 ? p2 : p1;
+	int i = cacheFind(c, lo, hi);
+	if (i != -1) {
+		c->entries[i].version = graphVersion;
+		c->entries[i].result = result;
+		cacheUnlink(c, i);
+		cachePushNewest(c, i);
+		return;
+	}
+
+	if (c->count < c->capacity) {
+		i = c->count++;
+	} else {
+		i = c->oldest;
+		cacheUnlink(c, i);
+		int *link = &c->buckets[cacheBucket(c, c->entries[i].lo, c->entries[i].hi)];
+		while (*link != i) {
+			link = &c->entries[*link].chain;
+		}
+		*link = c->entries[i].chain;
+		c->evictions++;
+	}
+
+	struct cacheEntry *e = &c->entries[i];
+	e->lo = lo;
+	e->hi = hi;
+	e->version = graphVersion;
+	e->result = result;
+	size_t b = cacheBucket(c, e->lo, e->hi);
+	e->chain = c->buckets[b];
+	c->buckets[b] = i;
+	cachePushNewest(c, i);
+}
+
+
+
+/*
+* cacheReserve(c, capacity) -- allocates room for capacity answers in c, with
+* about two buckets per entry. A capacity of 0 leaves the cache off.
+*/
+void cacheReserve(struct queryCache *c, int capacity) {
+	c->capacity = capacity;
+	if (capacity == 0) {
+		return;
+	}
+	c->nBuckets = 1;
+	while (c->nBuckets < (size_t) capacity * 2) {
+		c->nBuckets *= 2;
+	}
+	c->entries = mallocOrExit((size_t) capacity * sizeof(struct cacheEntry));
+	c->buckets = mallocOrExit(c->nBuckets * sizeof(int));
+	cacheClear(c);
+}
+
+
+
+/*
+* cacheFree(c) -- releases the arrays of c and turns it off.
+*/
+void cacheFree(struct queryCache *c) {
+	free(c->entries);
+	free(c->buckets);
+	c->entries = NULL;
+	c->buckets = NULL;
+	c->capacity = 0;
+	c->count = 0;
+	c->nBuckets = 0;
+}
+
+
+
+/*
+* printCacheStats(out) -- writes the size and hit rate of queryCache.
+*/
+void printCacheStats(FILE *out) {
+	size_t total = queryCache.hits + queryCache.misses;
+	double hitRate = total ? (double) queryCache.hits / total : 0.0;
+
+	fprintf(out, "Query cache: %d of %d answers, %zu hits, %zu misses (hit rate %.3f), "
+		"%zu evictions\n", queryCache.count, queryCache.capacity, queryCache.hits,
+		queryCache.misses, hitRate, queryCache.evictions);
+}
+
+
+
+/*
+* queryPath(s, id1, id2, r) -- puts the numbers along the answer r to the
+* query id1 / id2 into s->path: both ends for a direct call, the path of the
+* search that produced r (see tracePath) for an indirect connection.
+* Must be called before s runs another search.
+* Returns: the number of nodes written, 0 if r has no path.
+*/
+uint32_t queryPath(struct bfsScratch *s, uint32_t id1, uint32_t id2, struct queryResult r) {
+	if (r.status == QUERY_TALKED) {
+		// A direct call needs no search, so s may not be reserved yet.
+		reserveScratch(s, 2);
+		s->path[0] = id1;
+		s->path[1] = id2;
+		return 2;
+	}
+	if (r.status == QUERY_CONNECTED || r.status == QUERY_STRONGEST) {
+		return tracePath(s);
+	}
+	return 0;
+}
+
+
+
+/*
+* printPath(g, path, n) -- prints the n node ids at path as
+* "Path: ddd-ddd-dddd -> ddd-ddd-dddd -> ...", or nothing when n is 0.
+* The ids belong to g, or to the live graph (nodesById) when g is NULL.
+*/
+void printPath(struct csrGraph *g, const uint32_t *path, uint32_t n) {
+	char number[13];
+
+	if (n == 0) {
+		return;
+	}
+	fputs("Path:", stdout);
+	for (uint32_t i = 0; i < n; i++) {
+		formatPhoneKey(g != NULL ? g->keys[path[i]] : nodesById[path[i]]->key, number);
+		printf(i == 0 ? " %s" : " -> %s", number);
+	}
+	putchar('\n');
+}
+
+
+
+/*
+ * checkIfInGraph(p1, p2) -- Looks up two phone numbers, p1 and p2, in the current graph (through phoneIdx, or
+ * the number table of a loaded snapshot).
+ * If either phone number is not found, an error message is printed and the function returns 1. Otherwise it
+ * answers the query with answerQuery, using the shared queryScratch, and prints the number of calls if a direct
+ * connection is found or the number of numbers separating the two if they are indirectly connected. If no
+ * connection is found, it prints "Not connected".
+ * With -l the numbers along the connection are printed after the answer (printPath).
+ * Answers are kept in queryCache, so a repeated pair is printed without any lookup or search.
+ * With --live the query runs on the latest graph published by the writer (pinLiveGraph), and graphVersion
+ * moves to that graph so queryCache forgets answers computed on an older one.
+ * The function returns 0 if both phone numbers are found and processed.
+ */
+int checkIfInGraph(uint64_t p1, uint64_t p2) {
+    struct csrGraph *g = liveMode ? pinLiveGraph(0) : currentGraph();
+    struct queryResult result;
+    uint32_t id1, id2;
+    int missing = 0;
+
+    if (liveMode) {
+        graphVersion = g->version;
+    }
+
+    if (cacheLookup(&queryCache, p1, p2, &result)) {
+        printQueryResult(result);
+    } else if (graphFindNode(g, p1, &id1) || graphFindNode(g, p2, &id2)) {  // Either number is not in the graph
+        fprintf(stderr, "Phone Number Not Found.\n");
+        missing = 1;
+    } else {
+        result = answerQuery(g, &queryScratch, id1, id2);
+        cacheInsert(&queryCache, p1, p2, result);
+        printQueryResult(result);
+        if (printPaths) {
+            printPath(g, queryScratch.path, queryPath(&queryScratch, id1, id2, result));
+        }
+    }
+
+    if (liveMode) {
+        unpinLiveGraph(0);
+    }
+    return missing;
+}
+
+
+
+/*
+* answerStdinQueries() -- reads query lines from stdin until EOF and answers
+* each one with checkIfInGraph as soon as it is read.
+* Returns: 1 if any line had format errors, 0 otherwise.
+*/
+int answerStdinQueries() {
+	int errSeen = 0;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t lineLen;
+
+	while ((lineLen = getline(&line, &len, stdin)) > 0) {
+		uint64_t key1, key2;
+		if (parsePhoneLine(line, lineLen, &key1, &key2, &errSeen)) {
+			continue;
+		}
+
+		// First, check to see if phone nums are in graph
+		// then call BFS in that function
+		checkIfInGraph(key1, key2);
+		queriesAnswered++;
+	}
+	free(line);
+	return errSeen;
+}
+
+
+
+/*
+* checkLiveQuery(p1, p2) -- checkIfInGraph for --stream: answers the query on
+* the live phoneNode graph as it stands right now, without freezing it, since
+* the next line may add another call. A direct call is read off the edge; any
+* other pair gets a bidirectional search over the nodes' calls arrays
+* (--one-sided does not apply here). Prints the answer like checkIfInGraph.
+* Returns: 1 if either number is not in the graph yet, 0 otherwise.
+*/
+int checkLiveQuery(uint64_t p1, uint64_t p2) {
+	struct queryResult result = { QUERY_TALKED, 0 };
+
+	if (cacheLookup(&queryCache, p1, p2, &result)) {
+		printQueryResult(result);
+		return 0;
+	}
+
+	struct phoneNode *n1 = indexLookup(p1);
+	struct phoneNode *n2 = indexLookup(p2);
+	if (n1 == NULL || n2 == NULL) {
+		fprintf(stderr, "Phone Number Not Found.\n");
+		return 1;
+	}
+
+	struct edges *edge = findEdge(n1, n2);
+	if (edge != NULL) {
+		result.value = edge->totalCalls;
+	} else {
+		reserveScratch(&queryScratch, nodeCount);
+		double started = statsEnabled ? clockSeconds() : 0;
+		result.value = bidirectionalBFS(NULL, &queryScratch, n1->id, n2->id);
+		if (statsEnabled) {
+			recordSearch(&queryScratch, started);
+		}
+		result.status = result.value == -1 ? QUERY_NOT_CONNECTED : QUERY_CONNECTED;
+	}
+
+	cacheInsert(&queryCache, p1, p2, result);
+	printQueryResult(result);
+	if (printPaths) {
+		printPath(NULL, queryScratch.path, queryPath(&queryScratch, n1->id, n2->id, result));
+	}
+	return 0;
+}
+
+
+
+/*
+* runStream() -- reads stdin until EOF as a mix of call records and queries
+* (--stream): "+ddd-ddd-dddd ddd-ddd-dddd" adds one call to the graph and
+* "?ddd-ddd-dddd ddd-ddd-dddd" answers a query on every call added so far.
+* Whitespace may come before and after the sign. Adding a call moves
+* graphVersion on, so cached answers never outlive the graph they came from.
+* Returns: 1 if any line had format errors, 0 otherwise.
+*/
+int runStream() {
+	int errSeen = 0;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t lineLen;
+
+	while ((lineLen = getline(&line, &len, stdin)) > 0) {
+		char *rest = line;
+		while (isspace((unsigned char) *rest)) {
+			rest++;
+		}
+		char sign = *rest;
+		if (sign != '+' && sign != '?') {
+			if (*rest != '\0') {
+				fprintf(stderr, "Incorrect Format.\n");
+				errSeen = 1;
+			}
+			continue;
+		}
+		rest++;
+		while (*rest == ' ' || *rest == '\t') {
+			rest++;
+		}
+
+		uint64_t key1, key2;
+		if (parsePhoneLine(rest, lineLen - (rest - line), &key1, &key2, &errSeen)) {
+			continue;
+		}
+
+		if (sign == '+') {
+			addNodesToLL(key1, key2);
+			graphVersion++;
+			atomic_fetch_add(&linesRead, 1);
+		} else {
+			checkLiveQuery(key1, key2);
+			queriesAnswered++;
+		}
+	}
+	free(line);
+	return errSeen;
+}
+
+
+
+/*
+* printNeighborhood(g, s, start, k) -- prints every number within k hops of
+* node id start of g, one "ddd-ddd-dddd h" line per number with its hop
+* count h, nearest first. The BFS stops expanding at depth k instead of
+* running through the whole component. Lines are gathered in hopOutput and
+* written each time it fills, so even a hub with millions of numbers around
+* it needs no memory beyond s.
+* Returns: the number of numbers printed (start itself is not one of them).
+*/
+size_t printNeighborhood(struct csrGraph *g, struct bfsScratch *s, uint32_t start, int k) {
+	size_t used = 0;
+	uint32_t head = 0, tail = 0;
+
+	reserveScratch(s, g->nNodes);
+	uint32_t epoch = startSearch(s);
+	s->mark[start] = epoch;
+	s->level[start] = 0;
+	s->frontier[tail++] = start;
+
+	while (head < tail) {
+		uint32_t A = s->frontier[head++];
+		// Nodes leave the queue in level order, so the rest are at depth k too.
+		if (s->level[A] >= k) {
+			break;
+		}
+		for (size_t e = g->offsets[A]; e < g->offsets[A + 1]; e++) {
+			uint32_t child = g->adj[e];
+			if (s->mark[child] == epoch) {
+				continue;
+			}
+			s->mark[child] = epoch;
+			s->level[child] = s->level[A] + 1;
+			s->frontier[tail++] = child;
+
+			// Room for the number, a space, up to 10 digits, the newline and sprintf's NUL.
+			if (HOP_OUTPUT_SIZE - used < 32) {
+				fwrite(hopOutput, 1, used, stdout);
+				used = 0;
+			}
+			formatPhoneKey(g->keys[child], hopOutput + used);
+			used += 12;
+			used += sprintf(hopOutput + used, " %d\n", s->level[child]);
+		}
+	}
+	fwrite(hopOutput, 1, used, stdout);
+	s->visited = tail;
+	return tail - 1;
+}
+
+
+
+/*
+* answerHopQueries(path) -- (--hops K) reads one number per line from the file
+* named by path, or stdin when path is NULL, and answers each with
+* printNeighborhood, followed by "Within K hops: n numbers".
+* Returns: 1 if the file could not be opened or had format errors, 0 otherwise.
+*/
+int answerHopQueries(char *path) {
+	int errSeen = 0;
+	FILE *input = path != NULL ? fopen(path, "r") : stdin;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t lineLen;
+
+	if (input == NULL) {
+		fprintf(stderr, "Could Not Open File.\n");
+		return 1;
+	}
+
+	while ((lineLen = getline(&line, &len, input)) > 0) {
+		char *start = line;
+		char *end = line + lineLen;
+		uint64_t key;
+		uint32_t id;
+
+		while (start < end && isspace((unsigned char) *start)) {
+			start++;
+		}
+		while (end > start && isspace((unsigned char) end[-1])) {
+			end--;
+		}
+		if (checkPhoneFormat(start, end - start, &key)) {
+			fprintf(stderr, "Incorrect Format.\n");
+			errSeen = 1;
+			continue;
+		}
+
+		struct csrGraph *g = liveMode ? pinLiveGraph(0) : currentGraph();
+		if (graphFindNode(g, key, &id)) {
+			fprintf(stderr, "Phone Number Not Found.\n");
+		} else {
+			double started = statsEnabled ? clockSeconds() : 0;
+			size_t n = printNeighborhood(g, &queryScratch, id, hopLimit);
+			if (statsEnabled) {
+				recordSearch(&queryScratch, started);
+			}
+			printf("Within %d hops: %zu numbers\n", hopLimit, n);
+		}
+		if (liveMode) {
+			unpinLiveGraph(0);
+		}
+		queriesAnswered++;
+	}
+	free(line);
+	if (input != stdin) {
+		fclose(input);
+	}
+	return errSeen;
+}
+
+
 
 /*
-* queue -- node for a simple linked-list queue used in BFS.
-* pNode: pointer to the phoneNode stored in this queue entry.
-* next: pointer to the next entry in the queue.
+* batchQuery -- one line of a -q query file: the node ids of its two
+* numbers and, once a thread has answered it, the result. Queries with a
+* number missing from the graph are resolved to QUERY_NOT_FOUND up front.
+* pathWorker / pathAt / pathLen: with -l, where the path of the answer was
+* saved: the worker's paths array, the position in it and its number of
+* nodes (0 when the answer has no path).
 */
-struct queue {
-	struct phoneNode *pNode;
-	struct queue *next;
+struct batchQuery {
+	uint32_t id1;
+	uint32_t id2;
+	struct queryResult result;
+	uint32_t pathWorker;
+	size_t pathAt;
+	uint32_t pathLen;
 };
 
 
-
 /*
-* dequeue(head) -- removes and returns the front phoneNode from the queue.
-* head: pointer to the queue head pointer.
-* Returns: the dequeued phoneNode*, or NULL if the queue was empty.
-* Assumptions: *head is a valid pointer; queue entries have been allocated.
-* Side effects: frees the removed queue node.
+* batchOrder -- a found query of the batch as (id1 << 32 | id2) together with
+* its position in the query file. Sorting these puts every query of one
+* source number next to each other, ordered by target.
 */
-struct phoneNode* dequeue(struct queue **head) {
-    if (*head == NULL) {
-        return NULL;  // Return NULL if the queue is empty.
-    }
-    struct phoneNode *node = (*head)->pNode;
-    struct queue *temp = *head;
-    *head = (*head)->next;  // Move the head pointer to the next element
-    free(temp);
-    return node;
-}
+struct batchOrder {
+	uint64_t pair;
+	size_t query;
+};
 
 
+/*
+* batchJob -- queries shared by the threads of runBatchQueries.
+* g: the graph the numbers were resolved on.
+* order: the found queries sorted by source and target.
+* groupStarts: group g (all queries with one source) is
+*              order[groupStarts[g]] .. order[groupStarts[g + 1] - 1].
+* next: next unclaimed group; each thread claims BATCH_CHUNK groups at a time.
+* workers: one per thread, indexed by batchQuery.pathWorker.
+*/
+struct batchJob {
+	struct csrGraph *g;
+	struct batchQuery *queries;
+	size_t nQueries;
+	struct batchOrder *order;
+	size_t *groupStarts;
+	size_t nGroups;
+	atomic_size_t next;
+	struct batchWorker *workers;
+};
+
 
 /*
-* enqueue(head, pNode) -- creates a new queue entry holding pNode and appends it.
-* head: pointer to the queue head pointer.
-* pNode: pointer to the phoneNode to enqueue.
-* Returns: void.
-* Assumptions: head points to a valid queue pointer; memory allocation succeeds.
-* Side effects: allocates a new queue node and links it at the tail.
+* batchWorker -- per-thread state of runBatchQueries. g: the graph the thread
+* answers on; job->g, or with --live the graph it pinned itself. With -l,
+* paths holds the paths of every query the thread answered, one after
+* another (pathsLen of pathsCap ids used), so they can be printed in file
+* order afterwards.
 */
-void enqueue(struct queue **head, struct phoneNode *pNode) {
-    struct queue *node = malloc(sizeof(struct queue));
-    node->pNode = pNode;
-    node->next = NULL;
+struct batchWorker {
+	pthread_t thread;
+	struct batchJob *job;
+	struct csrGraph *g;
+	uint32_t *paths;
+	size_t pathsLen;
+	size_t pathsCap;
+};
 
-    if (*head == NULL) {
-        *head = node;  // If the queue is empty, the new node is the head.
-        return;
-    }
+#define BATCH_CHUNK 64
+// Sources with at least this many queries get one shared BFS (answerGroup);
+// fewer are cheaper as separate bidirectional searches.
+#define BATCH_GROUP_MIN 8
 
-    struct queue *cur = *head;
-    while (cur->next != NULL) {
-        cur = cur->next;
-    }
-    cur->next = node;  // Add the new node to the end of the queue
+
+
+/*
+* compareBatchOrder(a, b) -- qsort comparator on batchOrder.pair.
+*/
+int compareBatchOrder(const void *a, const void *b) {
+	uint64_t x = ((const struct batchOrder *) a)->pair;
+	uint64_t y = ((const struct batchOrder *) b)->pair;
+	return (x > y) - (x < y);
 }
 
 
 
-struct phoneNode *headLL = NULL;
+/*
+* keepPath(w, bq, s) -- with -l, appends the path of bq's answer (see
+* queryPath) to w->paths and records where it went. Does nothing otherwise.
+*/
+void keepPath(struct batchWorker *w, struct batchQuery *bq, struct bfsScratch *s) {
+	if (!printPaths) {
+		return;
+	}
 
+	uint32_t n = queryPath(s, bq->id1, bq->id2, bq->result);
+	if (w->pathsLen + n > w->pathsCap) {
+		while (w->pathsLen + n > w->pathsCap) {
+			w->pathsCap = w->pathsCap ? w->pathsCap * 2 : INDEX_INITIAL_CAPACITY;
+		}
+		w->paths = reallocOrExit(w->paths, w->pathsCap * sizeof(uint32_t));
+	}
+	memcpy(w->paths + w->pathsLen, s->path, n * sizeof(uint32_t));
+	bq->pathWorker = w - w->job->workers;
+	bq->pathAt = w->pathsLen;
+	bq->pathLen = n;
+	w->pathsLen += n;
+}
 
 
 
 /*
-* addEdges(p1, p2) -- ensures there is an undirected edge between phone nodes p1 and p2.
-* If an edge already exists in either direction, increments its totalCalls count;
-* otherwise allocates a new edge with totalCalls initialized to 1. Updates both p1->calls
-* and p2->calls to maintain bidirectional connectivity.
-* Assumes p1 and p2 are non-NULL and distinct.
+* answerGroup(w, s, order, n) -- answers the n queries at order, which share
+* one source and are sorted by target, with a single BFS from the source.
+* Direct calls are found in one pass over the source's neighbors (each
+* neighbor is binary searched among the targets). Every other target is
+* marked with an epoch of its own before the search, so the BFS knows when
+* it reaches one and stops as soon as all of them have been reached; the
+* answers are then read off the level array, and with -l each path is
+* traced back from its target. Results match answerQuery.
 */
-void addEdges(struct phoneNode *p1, struct phoneNode *p2) {
+void answerGroup(struct batchWorker *w, struct bfsScratch *s, struct batchOrder *order, size_t n) {
+	struct batchJob *job = w->job;
+	struct csrGraph *g = w->g;
+	uint32_t src = (uint32_t) (order[0].pair >> 32);
+
+	for (size_t i = 0; i < n; i++) {
+		job->queries[order[i].query].result.status = QUERY_NOT_CONNECTED;
+		job->queries[order[i].query].result.value = -1;
+	}
 
-	
-	struct edges *curEdge = p1->calls;
+	for (size_t e = g->offsets[src]; e < g->offsets[src + 1]; e++) {
+		size_t lo = 0, hi = n;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if ((uint32_t) order[mid].pair < g->adj[e]) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		for (; lo < n && (uint32_t) order[lo].pair == g->adj[e]; lo++) {
+			struct queryResult *r = &job->queries[order[lo].query].result;
+			if (r->status != QUERY_TALKED) {
+				r->status = QUERY_TALKED;
+				r->value = g->calls[e];
+			}
+		}
+	}
 
-	int alreadyFound = 0;
+	reserveScratch(s, g->nNodes);
+	uint32_t target = startSearch(s);
+	uint32_t epoch = startSearch(s);
+	size_t remaining = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		uint32_t id2 = (uint32_t) order[i].pair;
+		// A number and itself are never "connected", as in BFS, and other
+		// components are never reached.
+		if (id2 != src && s->mark[id2] != target && g->component[id2] == g->component[src]
+				&& job->queries[order[i].query].result.status != QUERY_TALKED) {
+			s->mark[id2] = target;
+			remaining++;
+		}
+	}
 
-	// No Edges in Node.
-	if (curEdge == NULL) {
-		struct edges *p2E = malloc(sizeof(struct edges));
-                
-		if (p2E == NULL) {
-			fprintf(stderr, "Not Enough Memory.\n");
-                        exit(1);
+	double started = statsEnabled ? clockSeconds() : 0;
+	uint32_t head = 0, tail = 0;
+	s->mark[src] = epoch;
+	s->level[src] = 0;
+	s->frontier[tail++] = src;
+	while (head < tail && remaining > 0) {
+		uint32_t A = s->frontier[head++];
+		for (size_t e = g->offsets[A]; e < g->offsets[A + 1]; e++) {
+			uint32_t child = g->adj[e];
+			if (s->mark[child] != epoch) {
+				if (s->mark[child] == target) {
+					remaining--;
+				}
+				s->mark[child] = epoch;
+				s->level[child] = s->level[A] + 1;
+				s->parent[child] = A;
+				s->frontier[tail++] = child;
+			}
 		}
+	}
+	s->visited = tail;
+	if (statsEnabled) {
+		recordSearch(s, started);
+	}
 
-		p2E->to = p2;
-                p2E->next = NULL;
-		p1->calls = p2E;
-		p2E->totalCalls = 1;
-                curEdge = p2E;
-		alreadyFound = 1;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t id2 = (uint32_t) order[i].pair;
+		struct queryResult *r = &job->queries[order[i].query].result;
+		if (r->status != QUERY_TALKED && id2 != src && s->mark[id2] == epoch) {
+			r->status = QUERY_CONNECTED;
+			r->value = s->level[id2] - 1;  // Subtract 1 to exclude the start node
+		}
+		s->meetFwd = id2;
+		s->meetBack = NO_NODE;
+		keepPath(w, &job->queries[order[i].query], s);
 	}
+}
 
-	while (curEdge != NULL) {
-		if (curEdge->to == p2 && !alreadyFound) {
-			curEdge->totalCalls++;
-			alreadyFound = 1;
-			break;
+
+
+/*
+* batchThread(arg) -- thread body of runBatchQueries: answers chunks of
+* groups of the shared batchJob with a bfsScratch of its own until none are
+* left. Large groups go through answerGroup, small ones (and every group with
+* --strongest, which answerGroup's BFS can't answer) through answerQuery.
+* With --live the thread pins the latest graph in its own reader slot (one
+* past its worker index; runBatchQueries unpins it once the paths are
+* printed). Node ids never change as the graph grows, so the ids resolved on
+* job->g are valid in it.
+*/
+void *batchThread(void *arg) {
+	struct batchWorker *w = arg;
+	struct batchJob *job = w->job;
+	struct bfsScratch scratch = { 0, NULL, NULL, NULL, NULL, NULL, NULL, 0, NO_NODE, NO_NODE, 0, NULL };
+	size_t first;
+
+	w->g = liveMode ? pinLiveGraph(w - job->workers + 1) : job->g;
+
+	while ((first = atomic_fetch_add(&job->next, BATCH_CHUNK)) < job->nGroups) {
+		size_t last = first + BATCH_CHUNK < job->nGroups ? first + BATCH_CHUNK : job->nGroups;
+		for (size_t grp = first; grp < last; grp++) {
+			struct batchOrder *order = job->order + job->groupStarts[grp];
+			size_t n = job->groupStarts[grp + 1] - job->groupStarts[grp];
+
+			if (n >= BATCH_GROUP_MIN && !strongestMode) {
+				answerGroup(w, &scratch, order, n);
+				continue;
+			}
+			for (size_t i = 0; i < n; i++) {
+				struct batchQuery *bq = &job->queries[order[i].query];
+				bq->result = answerQuery(w->g, &scratch, bq->id1, bq->id2);
+				keepPath(w, bq, &scratch);
+			}
 		}
-		if (curEdge->next == NULL) {
-			break;
+	}
+	freeScratch(&scratch);
+	return NULL;
+}
+
+
+
+/*
+* runBatchQueries(path, nThreads) -- answers every query line of the file
+* named by path on up to nThreads threads and prints the results in file
+* order, exactly as the stdin loop would. Numbers are resolved to node ids
+* while the file is read, so the threads only run read-only searches over
+* the frozen graph. Queries are grouped by source number so a busy source is
+* searched once for all of its targets (see answerGroup). Lines with format
+* errors are reported and skipped. With --live the numbers are resolved on
+* the graph published when the batch starts, and each thread answers on the
+* latest graph published when it starts (see batchThread).
+* Returns: 1 if the file could not be opened or had format errors, 0 otherwise.
+*/
+int runBatchQueries(char *path, int nThreads) {
+	int errSeen = 0;
+	FILE *input = fopen(path, "r");
+
+	if (input == NULL) {
+		fprintf(stderr, "Could Not Open File.\n");
+		return 1;
+	}
+
+	struct batchJob job;
+	job.g = liveMode ? pinLiveGraph(0) : currentGraph();
+	job.queries = NULL;
+	job.nQueries = 0;
+	atomic_init(&job.next, 0);
+
+	size_t capacity = 0;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t lineLen;
+	while ((lineLen = getline(&line, &len, input)) > 0) {
+		uint64_t key1, key2;
+		if (parsePhoneLine(line, lineLen, &key1, &key2, &errSeen)) {
+			continue;
+		}
+		if (job.nQueries == capacity) {
+			capacity = capacity ? capacity * 2 : INDEX_INITIAL_CAPACITY;
+			job.queries = reallocOrExit(job.queries, capacity * sizeof(struct batchQuery));
 		}
-		curEdge = curEdge->next;
+		struct batchQuery *bq = &job.queries[job.nQueries++];
+		int missing = graphFindNode(job.g, key1, &bq->id1) || graphFindNode(job.g, key2, &bq->id2);
+		bq->result.status = missing ? QUERY_NOT_FOUND : QUERY_NOT_CONNECTED;
+		bq->result.value = 0;
+		bq->pathLen = 0;
+	}
+	free(line);
+	fclose(input);
+	if (liveMode) {
+		unpinLiveGraph(0);
 	}
 
-	if (!alreadyFound) {
-		struct edges *p2E = malloc(sizeof(struct edges));
-		if (p2E == NULL) {
-                        fprintf(stderr, "Not Enough Memory.\n");
-                        exit(1);
-                }
-		p2E->to = p2;
-		p2E->next = NULL;
-		p2E->totalCalls = 1;
-		curEdge->next = p2E;
+	// Sort the found queries by source and cut them into one group per source.
+	size_t nFound = 0;
+	job.order = mallocOrExit(job.nQueries * sizeof(struct batchOrder));
+	for (size_t q = 0; q < job.nQueries; q++) {
+		if (job.queries[q].result.status != QUERY_NOT_FOUND) {
+			job.order[nFound].pair = (uint64_t) job.queries[q].id1 << 32 | job.queries[q].id2;
+			job.order[nFound].query = q;
+			nFound++;
+		}
 	}
+	qsort(job.order, nFound, sizeof(struct batchOrder), compareBatchOrder);
 
-	curEdge = p2->calls;
-	alreadyFound = 0;
-	
-	// No Edges in Node.
-        if (curEdge == NULL) {
-                struct edges *p1E = malloc(sizeof(struct edges));
-                if (p1E == NULL) {
-                        fprintf(stderr, "Not Enough Memory.\n");
-                        exit(1);
-                }
-		p1E->to = p1;
-                p1E->next = NULL;
-		p2->calls = p1E;
-		p1E->totalCalls = 1;
-                curEdge = p1E;
-		alreadyFound = 1;
-        }
+	job.groupStarts = mallocOrExit((nFound + 1) * sizeof(size_t));
+	job.nGroups = 0;
+	for (size_t i = 0; i < nFound; i++) {
+		if (i == 0 || job.order[i].pair >> 32 != job.order[i - 1].pair >> 32) {
+			job.groupStarts[job.nGroups++] = i;
+		}
+	}
+	job.groupStarts[job.nGroups] = nFound;
 
-        while (curEdge != NULL) {
-                if (curEdge->to == p1 && !alreadyFound) {
-			curEdge->totalCalls++;
-                        alreadyFound = 1;
-                        break;
-                }
-		if (curEdge->next == NULL) {
-			break;
+	job.workers = callocOrExit(nThreads, sizeof(struct batchWorker));
+	for (int t = 0; t < nThreads; t++) {
+		job.workers[t].job = &job;
+	}
+	if (nThreads > 1) {
+		for (int t = 0; t < nThreads; t++) {
+			if (pthread_create(&job.workers[t].thread, NULL, batchThread, &job.workers[t]) != 0) {
+				fprintf(stderr, "Could Not Start Thread.\n");
+				exit(1);
+			}
 		}
-                curEdge = curEdge->next;
-        }
+		for (int t = 0; t < nThreads; t++) {
+			pthread_join(job.workers[t].thread, NULL);
+		}
+	} else {
+		batchThread(&job.workers[0]);
+	}
 
-        if (!alreadyFound) {
-                struct edges *p1E = malloc(sizeof(struct edges));
-                if (p1E == NULL) {
-                        fprintf(stderr, "Not Enough Memory.\n");
-                        exit(1);
-                }
-		p1E->to = p1;
-                p1E->next = NULL;
-		p1E->totalCalls = 1;
-                curEdge->next = p1E;
-        }
+	queriesAnswered += job.nQueries;
+	for (size_t q = 0; q < job.nQueries; q++) {
+		struct batchQuery *bq = &job.queries[q];
+		printQueryResult(bq->result);
+		if (printPaths && bq->pathLen > 0) {
+			struct batchWorker *w = &job.workers[bq->pathWorker];
+			printPath(w->g, w->paths + bq->pathAt, bq->pathLen);
+		}
+	}
+	for (int t = 0; t < nThreads; t++) {
+		if (liveMode) {
+			unpinLiveGraph(t + 1);
+		}
+		free(job.workers[t].paths);
+	}
+	free(job.workers);
+	free(job.queries);
+	free(job.order);
+	free(job.groupStarts);
+	return errSeen;
 }
 
 
 
 /*
-* addNodesToLL(phoneNumber, phoneNumber2) -- ensures that both phone numbers
-* are present as nodes in the global linked list headLL and then connects them
-* by calling addEdges. If a phone number is not already in the list, allocates
-* and initializes a new phoneNode for it.
-*
-* phoneNumber    : null-terminated string in format "ddd-ddd-dddd" for the first number
-* phoneNumber2   : null-terminated string in format "ddd-ddd-dddd" for the second number
-* Returns        : void
-* Assumptions    : phoneNumber and phoneNumber2 are valid, non-null strings;
-*                  headLL is a global pointer to the start of the phoneNode list;
-*                  memory allocation succeeds (or else the program exits).
+* topEntry -- one candidate of a --top ranking: the packed number a
+* (b == TOP_NO_PAIR) with its total calls, or the pair a < b with the calls
+* between them.
 */
-void addNodesToLL(char *phoneNumber, char *phoneNumber2) {
+struct topEntry {
+	uint64_t weight;
+	uint64_t a;
+	uint64_t b;
+};
 
-	struct phoneNode *p1 = NULL;
-	struct phoneNode *p2 = NULL;
-	
-	if (headLL == NULL) {
-		p1 = malloc(sizeof(struct phoneNode));
-		if (p1 == NULL) {
-                        fprintf(stderr, "Not Enough Memory.\n");
-                        exit(1);
-                }
-		
-		strcpy(p1->pNumber, phoneNumber);
-		p1->calls = NULL;
-		p1->next = NULL;
-		p1->level = 0;
-		p1->queued = 0;
-		headLL = p1;
-	}
- 
-	int f1 = 1, f2 = 1;
-
-	struct phoneNode *cur = headLL;
-	struct phoneNode *behind = NULL;
-	while (cur != NULL) {
-		// First Phone Number found.
-		if (strcmp(cur->pNumber, phoneNumber) == 0) {
-			f1 = 0;
-			p1 = cur;
-		// Second Phone Number found.
-		} else if (strcmp(cur->pNumber, phoneNumber2) == 0) {
-			f2 = 0;
-			p2 = cur;
-		}
-		behind = cur;
-		cur = cur->next;
-	}
-
-	// Phone Number 1 wasn't found, Add it to LL
-	if (f1) {
-		p1 = malloc(sizeof(struct phoneNode));
-		if (p1 == NULL) {
-                	fprintf(stderr, "Not Enough Memory.\n");
-                	exit(1);
-        	}
-		strcpy(p1->pNumber, phoneNumber);
-		p1->calls = NULL;
-                p1->next = NULL;
-		p1->level = 0;
-		p1->queued = 0;
-		behind->next = p1;
-		behind = behind->next;
-	}
-
-        // Phone Number 2 wasn't found, Add it to LL
-	if (f2) {
-		p2 = malloc(sizeof(struct phoneNode));
-		if (p2 == NULL) {
-                	fprintf(stderr, "Not Enough Memory.\n");
-                	exit(1);
-        	}
-		strcpy(p2->pNumber, phoneNumber2);
-                p2->calls = NULL;
-                p2->next = NULL;
-		p2->level = 0;
-		p2->queued = 0;
-		behind->next = p2;
-	}	
-
-	addEdges(p1, p2);
-}
-
-
-
-/*
-* checkPhoneFormat(phoneNum) -- checks if the string phoneNum matches
-* the format ddd-ddd-dddd exactly. Returns 0 if valid, 1 otherwise.
-*
-* phoneNum: pointer to a null-terminated string representing a phone number.
-* Assumes: phoneNum is non-NULL.
+#define TOP_NO_PAIR UINT64_MAX
+
+
+/*
+* topHeap -- the k best topEntries seen so far, as a min-heap whose root
+* items[0] is the weakest of them, so a new candidate only has to beat it.
+*/
+struct topHeap {
+	struct topEntry *items;
+	uint32_t count;
+	uint32_t k;
+};
+
+
+/*
+* topJob -- nodes shared by the threads of printTopReport. Each thread claims
+* TOP_CHUNK node ids at a time through next.
 */
-int checkPhoneFormat(char *phoneNum) {
-	int index = 0;
+struct topJob {
+	struct csrGraph *g;
+	atomic_uint next;
+};
 
-    	while (*phoneNum != 0) {
-        	if (index > 12) {
-            		return 1;  // Too long
-        	}
+/*
+* topWorker -- per-thread state of printTopReport: its best numbers and pairs.
+*/
+struct topWorker {
+	pthread_t thread;
+	struct topJob *job;
+	struct topHeap numbers;
+	struct topHeap pairs;
+};
 
-        	if (index == 3 || index == 7) {
-            		if (*phoneNum != '-') {
-                		return 1;  // Dash expected
-            		}
-        	} else {
-            		if (*phoneNum < '0' || *phoneNum > '9') {
-                		return 1;  // Digit expected
-            		}
-        	}
+#define TOP_CHUNK 4096
 
-        	phoneNum++;
-        	index++;
-    	}
 
-   	if (index != 12) {
-        	return 1;  // Too short
-    	}
 
-    	return 0;  // Valid format
+/*
+* topBetter(x, y) -- whether x ranks above y: more calls first, then the
+* lower numbers, so the report doesn't depend on node ids or thread count.
+*/
+int topBetter(const struct topEntry *x, const struct topEntry *y) {
+	if (x->weight != y->weight) {
+		return x->weight > y->weight;
+	}
+	if (x->a != y->a) {
+		return x->a < y->a;
+	}
+	return x->b < y->b;
 }
 
 
 
 /*
-* parseFile(argv) -- opens the file named by argv and reads each line containing
-* two phone numbers in the format ddd-ddd-dddd. For each valid line, it adds
-* the pair to the global graph via addNodesToLL. Skips lines with format errors
-* (printing an error to stderr) but continues processing. Returns 1 if the file
-* could not be opened or any formatting errors were encountered; returns 0 otherwise.
+* topHeapInit(h, k) -- makes h an empty heap that keeps the best k entries.
 */
-int parseFile(char argv[]) {
+void topHeapInit(struct topHeap *h, uint32_t k) {
+	h->items = mallocOrExit((size_t) k * sizeof(struct topEntry));
+	h->count = 0;
+	h->k = k;
+}
 
-	int errSeen = 0;
-	
-	FILE *input = fopen(argv, "r");
 
-	if (input == NULL) {
-		fprintf(stderr, "Could Not Open File.\n");
-		return 1;
+
+/*
+* topHeapOffer(h, e) -- adds e to h if h is not full yet or e beats its
+* weakest entry, which then drops out. O(log k).
+*/
+void topHeapOffer(struct topHeap *h, struct topEntry e) {
+	uint32_t i;
+
+	if (h->count < h->k) {
+		// Sift up from the new leaf.
+		i = h->count++;
+		while (i > 0 && topBetter(&h->items[(i - 1) / 2], &e)) {
+			h->items[i] = h->items[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		h->items[i] = e;
+		return;
+	}
+	if (h->k == 0 || !topBetter(&e, &h->items[0])) {
+		return;
 	}
-	int retval;
-	char area[5], firstThree[5], lastFour[6], err[2];
-	char *line = NULL;
-	size_t len = 0;
-	while (getline(&line, &len, input) > 0) {
 
-		char *phoneNum = calloc(13, sizeof(char));
-		if (phoneNum == NULL) {
-			fprintf(stderr, "Ran Out of Memory.\n");
-			exit(1);
+	// Replace the root and sift down.
+	i = 0;
+	for (;;) {
+		uint32_t child = 2 * i + 1;
+		if (child >= h->count) {
+			break;
 		}
+		if (child + 1 < h->count && topBetter(&h->items[child], &h->items[child + 1])) {
+			child++;
+		}
+		if (!topBetter(&e, &h->items[child])) {
+			break;
+		}
+		h->items[i] = h->items[child];
+		i = child;
+	}
+	h->items[i] = e;
+}
+
+
+
+/*
+* compareTopEntry(a, b) -- qsort comparator putting the best entry first.
+*/
+int compareTopEntry(const void *a, const void *b) {
+	const struct topEntry *x = a;
+	const struct topEntry *y = b;
+
+	if (topBetter(x, y)) {
+		return -1;
+	}
+	return topBetter(y, x);
+}
+
 
-		int i = 0, j = 0;
-		int skipLine = 0;
-    		while (line[i] != 0) {
-        		if ((line[i] >= '0' && line[i] <= '9') || line[i] == '-') {
-            			if (j < 12) {
-                			phoneNum[j++] = line[i];
-            			} else if (! isspace(line[i])) {
-					fprintf(stderr, "Too Many Args Given");
-					skipLine = 1;
-					errSeen = 1;
-					break;
+
+/*
+* topThread(arg) -- thread body of printTopReport: for every node of the
+* claimed chunks, offers the node with the sum of its call counts and each of
+* its edges once (from the lower-id end) to the worker's heaps.
+*/
+void *topThread(void *arg) {
+	struct topWorker *w = arg;
+	struct csrGraph *g = w->job->g;
+	uint32_t first;
+
+	while ((first = atomic_fetch_add(&w->job->next, TOP_CHUNK)) < g->nNodes) {
+		uint32_t last = g->nNodes - first > TOP_CHUNK ? first + TOP_CHUNK : g->nNodes;
+		for (uint32_t u = first; u < last; u++) {
+			struct topEntry number = { 0, g->keys[u], TOP_NO_PAIR };
+			for (size_t e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+				uint32_t v = g->adj[e];
+				number.weight += g->calls[e];
+				if (v >= u) {
+					struct topEntry pair = { g->calls[e], g->keys[u], g->keys[v] };
+					if (pair.a > pair.b) {
+						pair.a = g->keys[v];
+						pair.b = g->keys[u];
+					}
+					topHeapOffer(&w->pairs, pair);
 				}
-        		} else {
-            			break;
-        		}
-        		i++;
-    		}
-		phoneNum[j] = 0;
-
-		char *phoneNum2 = calloc(13, sizeof(char));
-                if (phoneNum == NULL) {
-                        fprintf(stderr, "Ran Out of Memory.\n");
-                        exit(1);
-                }
-
-		// Skip whitespace
-		while (isspace(line[i])) {
-			i++;
+			}
+			topHeapOffer(&w->numbers, number);
 		}
+	}
+	return NULL;
+}
 
-                j = 0;
-                while (line[i] != 0) {
-                        if ((line[i] >= '0' && line[i] <= '9') || line[i] == '-') {
-                                if (j < 12) {
-                                        phoneNum2[j++] = line[i];
-                                } else if (! isspace(line[i])) {
-                                        fprintf(stderr, "Too Many Args Given");
-                                        errSeen = 1;
-					skipLine = 1;
-                                        break;
-                                }
-                        } else {
-                                break;
-                        }
-                        i++;
-                }
-                phoneNum2[j] = 0;
-	
-		while (line[i] != 0) {
-			// Extra Input was added.
-			if (! isspace(line[i])) {
-				errSeen = 1;
-				skipLine = 1;
-                        	fprintf(stderr, "Incorrect Format.\n");
-                        	break;
-			}
-			i++;
+
+
+/*
+* printTopEntries(title, h) -- prints the entries of h best first, after
+* sorting them in place.
+*/
+void printTopEntries(const char *title, struct topHeap *h) {
+	char number[13];
+
+	qsort(h->items, h->count, sizeof(struct topEntry), compareTopEntry);
+	printf("Top %u %s by calls:\n", h->count, title);
+	for (uint32_t i = 0; i < h->count; i++) {
+		formatPhoneKey(h->items[i].a, number);
+		printf("%u. %s", i + 1, number);
+		if (h->items[i].b != TOP_NO_PAIR) {
+			formatPhoneKey(h->items[i].b, number);
+			printf(" %s", number);
 		}
+		printf(" %llu calls\n", (unsigned long long) h->items[i].weight);
+	}
+}
 
-		if (skipLine) {
-			free(line);
-                	line = NULL;
-                	free(phoneNum);
-                	phoneNum = NULL;
-                	free(phoneNum2);
-                	phoneNum2 = NULL;
-			continue;
+
+
+/*
+* printTopReport(g, k, nThreads) -- prints the k numbers of g with the most
+* calls in total (the sum of totalCalls over their edges) and the k pairs
+* that called each other most, in one pass over g on nThreads threads. Each
+* thread keeps its own bounded heaps, which are merged at the end, so memory
+* stays O(k) per thread whatever the size of the graph; a k beyond the
+* number of nodes or adjacency entries is cut down to it.
+*/
+void printTopReport(struct csrGraph *g, uint32_t k, int nThreads) {
+	struct topJob job;
+
+	job.g = g;
+	atomic_init(&job.next, 0);
+
+	struct topWorker *workers = callocOrExit(nThreads, sizeof(struct topWorker));
+	for (int t = 0; t < nThreads; t++) {
+		workers[t].job = &job;
+		topHeapInit(&workers[t].numbers, k < g->nNodes ? k : g->nNodes);
+		topHeapInit(&workers[t].pairs, k < g->nEntries ? k : g->nEntries);
+	}
+	if (nThreads > 1) {
+		for (int t = 0; t < nThreads; t++) {
+			if (pthread_create(&workers[t].thread, NULL, topThread, &workers[t]) != 0) {
+				fprintf(stderr, "Could Not Start Thread.\n");
+				exit(1);
+			}
 		}
+		for (int t = 0; t < nThreads; t++) {
+			pthread_join(workers[t].thread, NULL);
+		}
+	} else {
+		topThread(&workers[0]);
+	}
 
-		// Too Many Characters, err had something in it.
-		if ((retval = sscanf(phoneNum, "%3s-%3s-%4s%1s", area, firstThree, lastFour, err)) == 4) {
-			errSeen = 1;
-			fprintf(stderr, "Incorrect Format.");
-			break;
+	// Worker 0's heaps collect the best of all the others.
+	for (int t = 1; t < nThreads; t++) {
+		for (uint32_t i = 0; i < workers[t].numbers.count; i++) {
+			topHeapOffer(&workers[0].numbers, workers[t].numbers.items[i]);
+		}
+		for (uint32_t i = 0; i < workers[t].pairs.count; i++) {
+			topHeapOffer(&workers[0].pairs, workers[t].pairs.items[i]);
 		}
-		// Too Many Characters, err had something in it.
-                if ((retval = sscanf(phoneNum2, "%3s-%3s-%4s%1s", area, firstThree, lastFour, err)) == 4) {
-                        errSeen = 1;
-                        fprintf(stderr, "Incorrect Format.");
-                        break;
-                }
-		int checkFormat = 0;
-		checkFormat += checkPhoneFormat(phoneNum);
-                checkFormat += checkPhoneFormat(phoneNum2);
-
-		// Incorrect Format
-		if (checkFormat) {
-			free(line);
-                        line = NULL;
-                        free(phoneNum);
-                        phoneNum = NULL;
-                        free(phoneNum2);
-                        phoneNum2 = NULL;
-			fprintf(stderr, "Incorrect Formating.\n");
-                        continue;
-		}
-
-		// printf("%s\n", line);
-		// printf("PHONE NUMBER: %s.\n", phoneNum);
-		// printf("PHONE NUMBER2: %s.\n", phoneNum2);
-
-		addNodesToLL(phoneNum, phoneNum2);
-
-		free(line);
-		line = NULL;
-		free(phoneNum);
-		phoneNum = NULL;
-		free(phoneNum2);
-                phoneNum2 = NULL;
 	}
-	return errSeen;
-}
+	printTopEntries("numbers", &workers[0].numbers);
+	printTopEntries("pairs", &workers[0].pairs);
 
+	for (int t = 0; t < nThreads; t++) {
+		free(workers[t].numbers.items);
+		free(workers[t].pairs.items);
+	}
+	free(workers);
+}
 
 
 
 /*
-* BFS(start, target) -- returns the number of intermediate nodes on the
-* shortest path between start and target in the phone-call graph.
-* It assumes the global list headLL contains all nodes and uses
-* a breadth-first search to find the shortest connection.
-* Returns -1 if no path exists.
+* printHotStats(out) -- writes the hotStats counters: lines, graph growth,
+* BFS work and its latency histogram, and heap allocations. Only reads
+* atomics, so it can run while other threads ingest or search.
 */
-int BFS(struct phoneNode *start, struct phoneNode *target) {
-    
-	// Reset the "queued" flag for all nodes before running BFS
-    	struct phoneNode *cur = headLL;
-    	while (cur != NULL) {
-        	cur->queued = 0;
-        	cur = cur->next;
-    	}
-	start->queued = 1;
-    	start->level = 0;
-
-    	// Initialize the queue as a pointer to pointer.
-    	struct queue *q = NULL;
-    
-    	// Pass the address of q to enqueue function
-    	enqueue(&q, start);  // Enqueue start node
-
-    	struct edges *children;
-    	while (q != NULL) {
-        	struct phoneNode *A = dequeue(&q);  // Pass the address of q to dequeue
-        	if (A == target) {
-            		return A->level - 1;  // Subtract 1 to exclude the start node
-        	}
-        	for (children = A->calls; children != NULL; children = children->next) {
-            		if (!children->to->queued) {
-                		children->to->queued = 1;
-                		children->to->level = A->level + 1;
-                		enqueue(&q, children->to);  // Pass the address of q to enqueue
-            		}
-        	}
-    	}
-    	return -1;  // Return -1 if no connection is found
-}
-
-
-
-/*
- * checkIfInGraph(p1, p2) -- Searches for two phone numbers, p1 and p2, in the linked list of phone nodes.
- * It checks if both phone numbers exist in the graph. If either phone number is not found, an error message is printed
- * and the function returns 1. If both numbers are found, it checks if they are directly connected by checking the 'calls'
- * list of the first phone number. If they are not directly connected, it performs a breadth-first search (BFS) to determine
- * if they are indirectly connected. The function prints the number of calls if a direct connection is found or the number of
- * numbers separating the two if they are indirectly connected. If no connection is found, it prints "Not connected".
- * The function returns 0 if both phone numbers are found and processed.
- */
-int checkIfInGraph(char *p1, char* p2) {
-    struct phoneNode *pn1 = NULL;
-    struct phoneNode *pn2 = NULL;
-    struct phoneNode *cur = headLL;  
-
-    int p1Found = 1;  
-    int p2Found = 1;
-
-    while (cur != NULL) {
-        if (strcmp(cur->pNumber, p1) == 0) {
-            p1Found = 0;  // Found p1
-            pn1 = cur;
-        }
+void printHotStats(FILE *out) {
+	size_t searches = atomic_load(&stats.searches);
+	size_t visited = atomic_load(&stats.nodesVisited);
+
+	fprintf(out, "Lines: %zu read, %zu rejected\n", atomic_load(&linesRead),
+		atomic_load(&stats.linesRejected));
+	fprintf(out, "Graph: %zu numbers and %zu edges created, %zu calls added to existing edges\n",
+		atomic_load(&stats.nodesCreated), atomic_load(&stats.edgesCreated),
+		atomic_load(&stats.edgeIncrements));
+	fprintf(out, "Searches: %zu, %zu nodes visited (%.1f per search, max %zu)\n", searches,
+		visited, searches ? (double) visited / searches : 0.0, atomic_load(&stats.maxVisited));
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		size_t count = atomic_load(&stats.searchLatency[b]);
+		if (count == 0) {
+			continue;
+		}
+		if (b == 0) {
+			fprintf(out, "  under 1 us: %zu searches\n", count);
+		} else {
+			fprintf(out, "  %llu-%llu us: %zu searches\n", 1ULL << (b - 1), 1ULL << b, count);
+		}
+	}
+	fprintf(out, "Heap allocations: %zu\n", atomic_load(&stats.heapAllocations));
+}
 
-        if (strcmp(cur->pNumber, p2) == 0) {
-            p2Found = 0;  // Found p2
-            pn2 = cur;
-        }
-        cur = cur->next;
-    }
 
-    if (p1Found || p2Found) {  // If either is still 1, then the number is not found
-        fprintf(stderr, "Phone Number Not Found.\n");
-        return 1;
-    }
 
-    struct edges *curEdge = pn1->calls;
-    int linkedCalls = 0;
+// SIGUSR1, blocked in every thread and taken by statsThread with sigwait.
+sigset_t statsSignals;
 
-    while (curEdge != NULL) {
-        if (pn2 == curEdge->to) {
-            linkedCalls += curEdge->totalCalls;
-            break;
-        }
-        curEdge = curEdge->next;
-    }
 
-    if (linkedCalls) {
-        printf("Talked %d times\n", linkedCalls);
-    } else {
-        int search = BFS(pn1, pn2);  // Perform BFS
 
-        if (search == -1) {
-            printf("Not connected\n");
-        } else {
-            printf("Connected through %d numbers\n", search);
-        }
-    }
+/*
+* statsThread(arg) -- waits for SIGUSR1 and writes the hot-path counters to
+* stderr each time it arrives, so a long session can be checked on without
+* stopping it.
+*/
+void *statsThread(void *arg) {
+	int sig;
+
+	(void) arg;
+	while (sigwait(&statsSignals, &sig) == 0) {
+		fputs("--- stats (SIGUSR1) ---\n", stderr);
+		printHotStats(stderr);
+	}
+	return NULL;
+}
+
+
 
-    return 0;
+/*
+* printBenchReport(out, ingestSeconds, querySeconds) -- writes the ingest rate
+* (input lines per second through parseFile), the query rate and the peak
+* resident set size of the process.
+*/
+void printBenchReport(FILE *out, double ingestSeconds, double querySeconds) {
+	struct rusage usage;
+	size_t lines = atomic_load(&linesRead);
+
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(out, "Bench ingest: %zu lines in %.3f s, %.0f lines/s\n", lines, ingestSeconds,
+		ingestSeconds > 0 ? lines / ingestSeconds : 0.0);
+	fprintf(out, "Bench queries: %zu queries in %.3f s, %.0f queries/s\n", queriesAnswered,
+		querySeconds, querySeconds > 0 ? queriesAnswered / querySeconds : 0.0);
+	fprintf(out, "Bench peak RSS: %ld KiB\n", usage.ru_maxrss);
 }
 
 
 
 /*
  * freePhoneList() -- Frees all dynamically allocated memory associated with the phone list.
- * It iterates through the linked list of phone nodes starting from headLL. For each phone node, 
- * it traverses and frees the associated edges (connections between phone nodes) in the 'calls' field. 
- * After freeing the edges, it frees the phone node itself. Once all nodes and their associated memory 
- * are freed, it sets headLL to NULL to indicate the list is empty.
+ * The phone nodes and their edges are all owned by graphArena, so they are released block by block
+ * instead of walking the list. The frozen graph, the BFS scratch and the hash index are freed too,
+ * and headLL is set to NULL to indicate the list is empty.
  */
 void freePhoneList() {
-    struct phoneNode *cur = headLL;  // headLL is a global variable
-    while (cur != NULL) {
-        struct phoneNode *temp = cur;
-        cur = cur->next;
-
-        // If you have other dynamically allocated memory within the phoneNode structure
-        // like the 'calls' field, make sure to free it too.
-        struct edges *call = temp->calls;
-        while (call != NULL) {
-            struct edges *callTemp = call;
-            call = call->next;
-            free(callTemp);  // Free the edge node
-        }
-
-        free(temp);  // Free the phoneNode
-    }
+    // Every phoneNode and edges record lives in graphArena, so releasing its
+    // blocks frees the whole list at once.
+    arenaRelease(&graphArena);
 
-    // Optionally, set headLL to NULL after freeing all the nodes, to indicate the list is empty.
+    // Set headLL to NULL after freeing all the nodes, to indicate the list is empty.
     headLL = NULL;
+    tailLL = NULL;
+    nodeCount = 0;
+    nodesById = NULL;
+    nodesByIdCap = 0;
+
+    freeCsrGraph(frozenGraph);
+    frozenGraph = NULL;
+    graphDirty = 1;
+    freeScratch(&queryScratch);
+    cacheFree(&queryCache);
+
+    free(phoneIdx.slots);
+    phoneIdx.slots = NULL;
+    phoneIdx.capacity = 0;
+    phoneIdx.count = 0;
 }
 
 
 int main(int argc, char* argv[]) {
 	
 	int errSeen = 0;
+	int filesGiven = 0;
+	char *saveSnapshotPath = NULL;
+	char *loadSnapshotPath = NULL;
+	char *queryPath = NULL;
+
+	// Options are pulled out of argv; every other argument is an input file.
+	char **files = mallocOrExit(argc * sizeof(char *));
+
+	int i = 1;
+
+	while (i < argc) {
+		if (strcmp(argv[i], "--stats") == 0) {
+			statsEnabled = 1;
+		} else if (strcmp(argv[i], "--bench") == 0) {
+			benchEnabled = 1;
+		} else if (strcmp(argv[i], "--one-sided") == 0) {
+			oneSidedSearch = 1;
+		} else if (strcmp(argv[i], "-l") == 0) {
+			printPaths = 1;
+		} else if (strcmp(argv[i], "--stream") == 0) {
+			streamMode = 1;
+		} else if (strcmp(argv[i], "--hops") == 0) {
+			if (i + 1 >= argc || (hopLimit = atoi(argv[i + 1])) < 1) {
+				fprintf(stderr, "Invalid Hop Count.\n");
+				free(files);
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--strongest") == 0) {
+			strongestMode = 1;
+		} else if (strcmp(argv[i], "--live") == 0) {
+			liveMode = 1;
+		} else if (strcmp(argv[i], "--top") == 0) {
+			if (i + 1 >= argc || (topCount = atoi(argv[i + 1])) < 1) {
+				fprintf(stderr, "Invalid Top Count.\n");
+				free(files);
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--cache") == 0) {
+			if (i + 1 >= argc || (queryCacheSize = atoi(argv[i + 1])) < 0) {
+				fprintf(stderr, "Invalid Cache Size.\n");
+				free(files);
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "-j") == 0) {
+			if (i + 1 >= argc || (ingestThreads = atoi(argv[i + 1])) < 1) {
+				fprintf(stderr, "Invalid Thread Count.\n");
+				free(files);
+				return 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "-q") == 0) {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "Missing Query File.\n");
+				free(files);
+				return 1;
+			}
+			queryPath = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "--save-snapshot") == 0 || strcmp(argv[i], "--load-snapshot") == 0) {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "Missing Snapshot File.\n");
+				free(files);
+				return 1;
+			}
+			if (strcmp(argv[i], "--save-snapshot") == 0) {
+				saveSnapshotPath = argv[i + 1];
+			} else {
+				loadSnapshotPath = argv[i + 1];
+			}
+			i++;
+		} else {
+			files[filesGiven++] = argv[i];
+		}
+		i++;
+	}
 
-	if (argc <= 1) {
+	// A report reads no queries, so every option about queries is a mistake.
+	if (topCount > 0 && (queryPath != NULL || hopLimit > 0 || strongestMode || streamMode || liveMode)) {
+		fprintf(stderr, "Incompatible Options: --top answers no queries.\n");
+		free(files);
+		return 1;
+	}
+	// Streamed queries search the live graph, which strongestPath and
+	// printNeighborhood don't cover, and a --hops query is a single number
+	// that has no strongest connection.
+	if ((streamMode && (strongestMode || hopLimit > 0)) || (strongestMode && hopLimit > 0)) {
+		fprintf(stderr, "Incompatible Options: --strongest and --hops can't be combined with each other or with --stream.\n");
+		free(files);
+		return 1;
+	}
+	if (filesGiven == 0 && loadSnapshotPath == NULL && !streamMode) {
 		fprintf(stderr, "Not enough File arguments Given.\n");
+		free(files);
 		return 1;
 	}
+	// Without files there is nothing to ingest next to the queries; a stream
+	// adds its calls on the query thread itself.
+	if (filesGiven == 0 || streamMode) {
+		liveMode = 0;
+	}
 
-	int i = 1;
+	// Block SIGUSR1 before any other thread exists so that only statsThread
+	// ever receives it.
+	if (statsEnabled) {
+		pthread_t reporter;
+		sigemptyset(&statsSignals);
+		sigaddset(&statsSignals, SIGUSR1);
+		pthread_sigmask(SIG_BLOCK, &statsSignals, NULL);
+		if (pthread_create(&reporter, NULL, statsThread, NULL) == 0) {
+			pthread_detach(reporter);
+		}
+	}
 
-	while (i < argc) {
+	double ingestStart = clockSeconds();
 
-		errSeen += parseFile(argv[i]);
-		i++;
+	if (loadSnapshotPath != NULL) {
+		frozenGraph = loadSnapshot(loadSnapshotPath);
+		if (frozenGraph == NULL) {
+			free(files);
+			return 1;
+		}
+		graphDirty = 0;
+
+		// New files or streamed calls go on top of the snapshot, which has to
+		// become a modifiable graph again. Without them queries run on the mapping.
+		if (filesGiven > 0 || streamMode) {
+			thawGraph(frozenGraph);
+			freeCsrGraph(frozenGraph);
+			frozenGraph = NULL;
+		}
 	}
 
-	// Need to parse from stdin to check BFS and then to print out the message
-	
-	int retval;
-        char area[5], firstThree[5], lastFour[6], err[2];
-        char *line = NULL;
-        size_t len = 0;
-        while (getline(&line, &len, stdin) > 0) {
-
-                char *phoneNum = calloc(13, sizeof(char));
-                if (phoneNum == NULL) {
-                        fprintf(stderr, "Ran Out of Memory.\n");
-                        exit(1);
-                }
-
-                int i = 0, j = 0;
-                int skipLine = 0;
-                while (line[i] != 0) {
-                        if ((line[i] >= '0' && line[i] <= '9') || line[i] == '-') {
-                                if (j < 12) {
-                                        phoneNum[j++] = line[i];
-                                } else if (! isspace(line[i])) {
-                                        fprintf(stderr, "Too Many Args Given");
-                                        skipLine = 1;
-                                        errSeen = 1;
-                                        break;
-                                }
-                        } else {
-                                break;
-                        }
-                        i++;
-                }
-                phoneNum[j] = 0;
-
-                char *phoneNum2 = calloc(13, sizeof(char));
-                if (phoneNum == NULL) {
-                        fprintf(stderr, "Ran Out of Memory.\n");
-                        exit(1);
-                }
-
-                // Skip whitespace
-                while (isspace(line[i])) {
-                        i++;
-                }
-
-                j = 0;
-                while (line[i] != 0) {
-                        if ((line[i] >= '0' && line[i] <= '9') || line[i] == '-') {
-                                if (j < 12) {
-                                        phoneNum2[j++] = line[i];
-                                } else if (! isspace(line[i])) {
-                                        fprintf(stderr, "Too Many Args Given");
-                                        errSeen = 1;
-                                        skipLine = 1;
-                                        break;
-                                }
-                        } else {
-                                break;
-                        }
-                        i++;
-                }
-                phoneNum2[j] = 0;
-
-                while (line[i] != 0) {
-                        // Extra Input was added.
-                        if (! isspace(line[i])) {
-                                errSeen = 1;
-                                skipLine = 1;
-                                fprintf(stderr, "Incorrect Format.\n");
-                                break;
-                        }
-                        i++;
-                }
-
-                if (skipLine) {
-                        free(line);
-                        line = NULL;
-                        free(phoneNum);
-                        phoneNum = NULL;
-                        free(phoneNum2);
-                        phoneNum2 = NULL;
-                        continue;
-                }
-
-                // Too Many Characters, err had something in it.
-                if ((retval = sscanf(phoneNum, "%3s-%3s-%4s%1s", area, firstThree, lastFour, err)) == 4) {
-                        errSeen = 1;
-                        fprintf(stderr, "Incorrect Format.");
-                        break;
-                }
-                // Too Many Characters, err had something in it.
-                if ((retval = sscanf(phoneNum2, "%3s-%3s-%4s%1s", area, firstThree, lastFour, err)) == 4) {
-                        errSeen = 1;
-                        fprintf(stderr, "Incorrect Format.");
-                        break;
-                }
-                int checkFormat = 0;
-                checkFormat += checkPhoneFormat(phoneNum);
-                checkFormat += checkPhoneFormat(phoneNum2);
-
-                // Incorrect Format
-                if (checkFormat) {
-                        free(line);
-                        line = NULL;
-                        free(phoneNum);
-                        phoneNum = NULL;
-                        free(phoneNum2);
-                        phoneNum2 = NULL;
-                        fprintf(stderr, "Incorrect Formating.\n");
-                        continue;
-                }
-
-                // CALL BFS FUNCTIONs
-		// First, check to see if phone nums are in graph
-		// then call BFS in that function
-		checkIfInGraph(phoneNum, phoneNum2);
-
-                free(line);
-                line = NULL;
-                free(phoneNum);
-                phoneNum = NULL;
-                free(phoneNum2);
-                phoneNum2 = NULL;
-        }
+	struct liveIngest live;
+	if (liveMode) {
+		// The files are parsed on a writer thread; queries start right away.
+		live.files = files;
+		live.nFiles = filesGiven;
+		// The writer parses straight into the graph so it can publish as it
+		// goes, so -j only sets the number of -q reader threads here.
+		startLiveIngest(&live, ingestThreads + 1);
+	} else if (ingestThreads > 1 && filesGiven > 1) {
+		errSeen += parallelIngest(files, filesGiven, ingestThreads);
+	} else {
+		for (i = 0; i < filesGiven; i++) {
+			errSeen += parseFile(files[i]);
+		}
+	}
+
+	// The freeze below isn't parsing, so --bench stops the ingest clock first.
+	double ingestSeconds = clockSeconds() - ingestStart;
+
+	// The graph is read-only from here on, so build the CSR copy up front.
+	// A stream keeps adding calls, so it searches the live graph instead.
+	if (!streamMode && !liveMode) {
+		currentGraph();
+	}
+
+	if (saveSnapshotPath != NULL && !streamMode && !liveMode) {
+		errSeen += saveSnapshot(frozenGraph, saveSnapshotPath);
+	}
+
+	double queryStart = clockSeconds();
+	if (topCount > 0) {
+		printTopReport(frozenGraph, topCount, ingestThreads);
+	} else if (streamMode) {
+		cacheReserve(&queryCache, printPaths ? 0 : queryCacheSize);
+		errSeen += runStream();
+		if (saveSnapshotPath != NULL) {
+			errSeen += saveSnapshot(currentGraph(), saveSnapshotPath);
+		}
+	} else if (hopLimit > 0) {
+		errSeen += answerHopQueries(queryPath);
+	} else if (queryPath != NULL) {
+		errSeen += runBatchQueries(queryPath, ingestThreads);
+	} else {
+		// Cached answers carry no path, so -l runs without the cache.
+		cacheReserve(&queryCache, printPaths ? 0 : queryCacheSize);
+		errSeen += answerStdinQueries();
+	}
+	double querySeconds = clockSeconds() - queryStart;
 
+	if (liveMode) {
+		errSeen += finishLiveIngest(&live);
+		ingestSeconds = live.seconds;
+		if (saveSnapshotPath != NULL) {
+			errSeen += saveSnapshot(frozenGraph, saveSnapshotPath);
+		}
+	}
+	free(files);
+
+
+	if (statsEnabled) {
+		printHotStats(stderr);
+		printIndexStats(stderr);
+		printArenaStats(stderr);
+		printCacheStats(stderr);
+		struct csrGraph *g = currentGraph();
+		fprintf(stderr, "Frozen graph: %u numbers, %zu adjacency entries\n",
+			g->nNodes, g->nEntries);
+		printComponentStats(stderr, g);
+	}
+	if (benchEnabled) {
+		printBenchReport(stderr, ingestSeconds, querySeconds);
+	}
 
 	freePhoneList();
 